@@ -1,20 +1,64 @@
+#define _GNU_SOURCE
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+extern char** environ;
+
 #define CMDLINE_MAX 512
 #define TOKEN_MAX 32
 #define ARG_MAX 16
 #define PROCESS_MAX 8
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define INPUT_BUF_SIZE (64 * 1024)
+#define PATH_CACHE_SIZE 64
+#define JOB_MAX 32
+#define BUILTIN_TABLE_SIZE 32
+#define SLS_BUF_SIZE (256 * 1024)
+#define SCAN_BUF_SIZE (1024 * 1024)
+#define BENCH_PARSE_ITERS 20000
+#define BENCH_SPAWN_ITERS 200
+#define BENCH_COLD_ITERS 100
+#define STATS_DUMP_INTERVAL 256
+#define RESULT_CACHE_SIZE 64
+#define RESULT_CACHE_TTL_NS (30ull * 1000000000ull)
+#define HISTORY_CHUNK (64 * 1024)
+#define HISTORY_SYNC_INTERVAL 64
+#define SCAN_CACHE_SIZE 16
+#define PLAN_CACHE_SIZE 32
+#define PLAN_WORD_MAX 64
+#define ENV_INDEX_SIZE 1024
+#define ENV_NAME_MAX 64
+#define PREFORK_MAX 64
+#define PREFORK_MSG_MAX 4096
+#define SPLICE_CHUNK_SIZE (1024 * 1024)
 
 struct process {
-        char* argv[ARG_MAX + 1];
+        /* points at argv_inline until the argument list outgrows it */
+        char** argv;
+        char* argv_inline[ARG_MAX + 1];
         int fd_in;
         int fd_out;
         int fd_err;
@@ -45,443 +89,4782 @@ void exit_with_sys_err(const char* func_name)
         exit(EXIT_FAILURE);
 }
 
-/* SECTION 1: Build-in Commands */
+/* SECTION 1: Arena Allocator */
 
 /**
- * @brief print the current working directory
+ * a block of arena memory.
+ * blocks are chained so the arena can grow when a commandline needs more
+ * memory than one block, and they are kept across resets for reuse.
+ */
+struct arena_block {
+        struct arena_block* next;
+        size_t size;
+        char data[];
+};
+
+/* head of the arena block chain (first block allocated) */
+static struct arena_block* arena_head;
+
+/* block currently being allocated from */
+static struct arena_block* arena_cur;
+
+/* number of bytes used in the current block */
+static size_t arena_used;
+
+/* number of allocations served (reported by the bench harness) */
+static size_t arena_alloc_count;
+
+/* a saved arena position for scoped rewinds */
+struct arena_mark {
+        struct arena_block* cur;
+        size_t used;
+};
+
+/**
+ * @brief allocate memory valid until the next call to `arena_reset`
  *
- * @return 0 if successful; -1 otherwise
+ * all per-commandline allocations (tokens, processes) come from the arena,
+ * so there is no need to free them individually; a single `arena_reset`
+ * reclaims everything after the commandline completes.
+ *
+ * @param size the number of bytes to allocate
+ * @return pointer to the allocated memory (never NULL)
  */
-int pwd(void)
+void* arena_alloc(size_t size)
 {
-        char cwd[PATH_MAX];
+        arena_alloc_count++;
 
-        if (!getcwd(cwd, PATH_MAX))
-                return -1;
+        /* round up so every allocation stays suitably aligned */
+        size = (size + 15) & ~(size_t)15;
 
-        printf("%s\n", cwd);
-        return 0;
+        /* advance to a block with enough room, reusing kept blocks first */
+        while (!arena_cur || arena_used + size > arena_cur->size) {
+                struct arena_block* next = arena_cur ? arena_cur->next : arena_head;
+
+                if (!next) {
+                        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+                        next = malloc(sizeof(struct arena_block) + block_size);
+
+                        /* check malloc failure */
+                        if (!next)
+                                exit(EXIT_FAILURE);
+
+                        next->next = NULL;
+                        next->size = block_size;
+
+                        /* link the new block into the chain */
+                        if (arena_cur)
+                                arena_cur->next = next;
+                        else
+                                arena_head = next;
+                }
+
+                arena_cur = next;
+                arena_used = 0;
+        }
+
+        void* ptr = arena_cur->data + arena_used;
+        arena_used += size;
+
+        return ptr;
 }
 
 /**
- * @brief change the working directory
+ * @brief reclaim all arena memory with a single pointer move
  *
- * @param path path of the working directory to change to
- * @return 0 if successful; -1 otherwise
+ * blocks are kept for reuse by the next commandline, so the hot path
+ * performs no free or malloc calls in steady state.
  */
-int cd(const char* path)
+void arena_reset(void)
 {
-        if (chdir(path))
-                return error("cannot cd into directory");
+        arena_cur = arena_head;
+        arena_used = 0;
+}
 
-        return 0;
+/**
+ * @brief save the current arena position for a later scoped rewind
+ */
+struct arena_mark arena_save(void)
+{
+        struct arena_mark mark = { arena_cur, arena_used };
+
+        return mark;
 }
 
 /**
- * @brief list contents in current directory
+ * @brief rewind the arena to a previously saved position
  *
- * @return 0 if successful; -1 otherwise
+ * everything allocated after the matching `arena_save` is reclaimed;
+ * earlier allocations stay valid (unlike a full `arena_reset`).
  */
-int sls(void)
+void arena_restore(struct arena_mark mark)
 {
-        DIR* dir_p = opendir("./");
-        struct dirent* ent_p;
-        struct stat ent_st;
+        arena_cur = mark.cur;
+        arena_used = mark.used;
+}
 
-        if (!dir_p)
-                return error("cannot open directory");
+/* SECTION 2: PATH Resolution Cache */
 
-        /* iterate over entries in the directory */
-        while ((ent_p = readdir(dir_p))) {
-                /* get stat for the current entry */
-                if (stat(ent_p->d_name, &ent_st)) {
-                        perror("sls");
-                        return -1;
-                }
+/* an entry mapping a command name to its resolved absolute path */
+struct path_cache_entry {
+        char name[TOKEN_MAX];
+        char path[PATH_MAX];
+};
 
-                /* print filename and size if the file is not hidden */
-                if (ent_p->d_name[0] != '.')
-                        printf("%s (%ld bytes)\n", ent_p->d_name, ent_st.st_size);
-        }
+/* open-addressing hash table over resolved command paths */
+static struct path_cache_entry path_cache[PATH_CACHE_SIZE];
+
+/**
+ * @brief hash a string (djb2)
+ */
+size_t hash_str(const char* s)
+{
+        size_t h = 5381;
 
-        (void)closedir(dir_p);
+        while (*s)
+                h = h * 33 + (unsigned char)*s++;
 
-        return 0;
+        return h;
 }
 
-/* SECTION 2: Commandline Tokenization (Lexical Analysis) */
-
 /**
- * @brief read the next commandline token from a stream of characters.
+ * @brief look up the resolved path of a command name in the cache
  *
- * @param iter the current position of the char iterator
- * @param buf the buffer to store the token read
- * @return
- * the pointer pointing to the next charater after the end of the token read;
- * `NULL` when the string terminator is reached.
+ * @param name command name
+ * @return the cached absolute path; NULL if the name is not cached
  */
-const char* read_next_token(const char* iter, char* buf) {
-        /* move the iterator to the first non-whitespace character */
-        while (*iter == ' ' || *iter == '\t')
-                iter++;
-
-        /* return NULL when string terminator is reached */
-        if (*iter == '\0')
-                return NULL;
+const char* path_cache_lookup(const char* name)
+{
+        size_t slot = hash_str(name) % PATH_CACHE_SIZE;
 
-        /* read the 1st token char */
-        *buf = *iter++;
+        /* probe linearly; an empty slot ends the probe chain */
+        for (size_t i = 0; i < PATH_CACHE_SIZE; i++) {
+                struct path_cache_entry* ent = &path_cache[(slot + i) % PATH_CACHE_SIZE];
 
-        /* determine the token type by looking at the first character */
-        switch (*buf++) {
-        /* the token is an operator */
-        case '|':
-        case '>':
-                if (*iter == '&')
-                        *buf++ = *iter++;
-                break;
+                if (!ent->name[0])
+                        return NULL;
 
-        /* the token is an argument */
-        default:
-                while (*iter && *iter != ' ' && *iter != '\t' && *iter != '|' && *iter != '>')
-                        *buf++ = *iter++;
-                break;
+                if (!strcmp(ent->name, name))
+                        return ent->path;
         }
 
-        /* terminate string */
-        *buf = '\0';
-
-        /* return the current position of the iterator */
-        return iter;
+        return NULL;
 }
 
 /**
- * @brief read a commandline into tokens
+ * @brief insert a resolved command path into the cache
  *
- * @param cmdline the string tokens should be read from
- * @param tokens null-terminated list output of tokens read from the string
+ * @param name command name
+ * @param path resolved path of the command
+ * @return the stored copy of the path; NULL if the entry cannot be cached
  */
-void read_tokens(const char* cmdline, char* tokens[])
+const char* path_cache_insert(const char* name, const char* path)
 {
-        char token_buf[TOKEN_MAX];
+        /* overlong entries are not cached (the caller falls back to execvp) */
+        if (strlen(name) >= TOKEN_MAX || strlen(path) >= PATH_MAX)
+                return NULL;
 
-        while ((cmdline = read_next_token(cmdline, token_buf))) {
-                *tokens = malloc(TOKEN_MAX * sizeof(char));
+        size_t slot = hash_str(name) % PATH_CACHE_SIZE;
 
-                /* check malloc failure */
-                if (!*tokens)
-                        exit(EXIT_FAILURE);
+        for (size_t i = 0; i < PATH_CACHE_SIZE; i++) {
+                struct path_cache_entry* ent = &path_cache[(slot + i) % PATH_CACHE_SIZE];
 
-                strcpy(*tokens++, token_buf);
+                if (!ent->name[0] || !strcmp(ent->name, name)) {
+                        strcpy(ent->name, name);
+                        strcpy(ent->path, path);
+                        return ent->path;
+                }
         }
 
-        /* terminate token array */
-        *tokens = NULL;
+        /* table full: skip caching rather than evict mid-probe chain */
+        return NULL;
 }
 
 /**
- * @brief determines if the token is an argument
+ * @brief drop all cached command paths
+ *
+ * called when the working directory changes (relative PATH components
+ * would resolve differently) and by the `rehash` built-in command.
  */
-bool is_arg(const char* token)
+void path_cache_flush(void)
 {
-        return token && token[0] != '>' && token[0] != '|';
+        for (size_t i = 0; i < PATH_CACHE_SIZE; i++)
+                path_cache[i].name[0] = '\0';
 }
 
 /**
- * @brief determines if the token is a pipe token
+ * @brief resolve a command name to an executable path, using the cache
+ *
+ * on a cache miss, each `$PATH` directory is probed once and the result
+ * is cached, so repeated launches of the same command skip the per-launch
+ * filesystem walk execvp would otherwise redo.
+ *
+ * @param name command name
+ * @return the resolved path; NULL if the name cannot be resolved (or cached)
  */
-bool is_pipe_token(const char* token)
+const char* resolve_command(const char* name)
 {
-        return token && token[0] == '|';
+        /* names containing a slash bypass the PATH search entirely */
+        if (strchr(name, '/'))
+                return name;
+
+        const char* cached = path_cache_lookup(name);
+
+        if (cached)
+                return cached;
+
+        char candidate[PATH_MAX];
+        const char* p = getenv("PATH");
+
+        while (p) {
+                const char* colon = strchr(p, ':');
+                size_t dir_len = colon ? (size_t)(colon - p) : strlen(p);
+
+                /* an empty PATH component means the current directory */
+                int n = snprintf(candidate, PATH_MAX, "%.*s%s%s",
+                                 (int)dir_len, p, dir_len ? "/" : "", name);
+
+                if (n > 0 && n < PATH_MAX && !access(candidate, X_OK))
+                        return path_cache_insert(name, candidate);
+
+                p = colon ? colon + 1 : NULL;
+        }
+
+        return NULL;
 }
 
+/* SECTION 3: Directory Scanner */
+
+/* layout of the entries the raw getdents64 syscall returns */
+struct linux_dirent64 {
+        unsigned long long d_ino;
+        long long d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+};
+
 /**
- * @brief determines if the token is an output redirect token
+ * a directory scan callback.
+ * receives the scanned directory's fd (for fstatat), the entry name, and
+ * the entry's d_type; name-only consumers can rely on d_type and skip
+ * the stat entirely. a nonzero return stops the scan.
  */
-bool is_out_redirect_token(const char* token)
-{
-        return token && token[0] == '>';
-}
-
-/* SECTION 3: Commandline Parsing */
+typedef int (*scan_fn)(int dir_fd, const char* name, unsigned char type, void* ctx);
 
 /**
- * @brief read command arguments from a stream of tokens
+ * @brief scan a directory with bulk getdents64 batches
  *
- * @param token_iter current position of token iterator
- * @param argv null-terminated list output of arguments read from token stream
- * @return
- * the new position of the token iterator pointing to the next token after the last argument read;
- * `NULL` if there is no or too many arguments.
+ * one getdents64 call fills a multi-megabyte batch buffer, so scanning a
+ * million-entry directory takes a handful of syscalls instead of a libc
+ * readdir round trip per entry.
+ *
+ * @param dir_fd fd of the directory to scan (opened with O_DIRECTORY)
+ * @param fn callback invoked for every entry
+ * @param ctx opaque context passed through to the callback
+ * @return 0 if the whole directory was scanned;
+ * -1 if getdents64 failed; otherwise the callback's nonzero return
  */
-char** read_argv(char** token_iter, char* argv[])
+int scan_dir(int dir_fd, scan_fn fn, void* ctx)
 {
-        size_t i = 0;
+        static char buf[SCAN_BUF_SIZE];
 
-        while (is_arg(*token_iter)) {
-                if (i == ARG_MAX) {
-                        (void)error("too many process arguments");
-                        return NULL;
-                }
+        while (true) {
+                long n = syscall(SYS_getdents64, dir_fd, buf, SCAN_BUF_SIZE);
 
-                argv[i++] = *token_iter++;
-        }
+                if (n == -1)
+                        return -1;
 
-        argv[i] = NULL;
+                if (!n)
+                        return 0;
 
-        if (!argv[0]) {
-                (void)error("missing command");
-                return NULL;
-        }
+                for (long off = 0; off < n;) {
+                        struct linux_dirent64* ent = (struct linux_dirent64*)(buf + off);
+                        int ret = fn(dir_fd, ent->d_name, ent->d_type, ctx);
 
-        return token_iter;
+                        if (ret)
+                                return ret;
+
+                        off += ent->d_reclen;
+                }
+        }
 }
 
+/* SECTION 4: Build-in Commands */
+
 /**
- * @brief create a pipe between two processes
+ * @brief print the current working directory
  *
- * @param src source process that will write to the pipe
- * @param dest destination process that will read from the pipe
- * @param redirect_err whether the error of the source process will be redirected to the pipe
- * @return 0 if pipe creation is successful; -1 otherwise
+ * @return 0 if successful; -1 otherwise
  */
-int pipe_procs(struct process* src, struct process* dest, bool redirect_err)
+int pwd(void)
 {
-        int pipe_fds[2];
-
-        if (pipe(pipe_fds))
-                exit_with_sys_err("pipe");
+        char cwd[PATH_MAX];
 
-        src->fd_out = pipe_fds[1];
-        src->fd_err = redirect_err ? pipe_fds[1] : STDERR_FILENO;
-        dest->fd_in = pipe_fds[0];
+        if (!getcwd(cwd, PATH_MAX))
+                return -1;
 
+        printf("%s\n", cwd);
         return 0;
 }
 
 /**
- * @brief redirect the output of a process to a file
+ * @brief change the working directory
  *
- * @param proc the process for which the output needs to be redirected
- * @param out_file_path the path of the output file
- * @param redirect_err whether the error of the process should be redirected to the output file
+ * @param path path of the working directory to change to
  * @return 0 if successful; -1 otherwise
  */
-int redirect_proc_out(struct process* proc, const char* out_file_path, bool redirect_err)
+int cd(const char* path)
 {
-        /* if the file already exists, truncate the length to 0; */
-        /* if the file does not exists, create it with permission rw-r--r--. */
-        int fd = open(out_file_path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-
-        if (fd == -1)
-                return error("cannot open output file");
+        if (chdir(path))
+                return error("cannot cd into directory");
 
-        proc->fd_out = fd;
-        proc->fd_err = redirect_err ? fd : STDERR_FILENO;
+        /* relative PATH components now resolve differently */
+        path_cache_flush();
 
         return 0;
 }
 
+/* output accumulation state for one sls listing */
+struct sls_ctx {
+        int out_fd;
+        size_t used;
+        char buf[SLS_BUF_SIZE];
+};
+
 /**
- * @brief parse a commandline into a list of processes
- * each with an argument list and file descriptors for input, output, and error
+ * @brief handle one scanned directory entry for sls
  *
- * @param cmdline commandline
- * @param procs null-terminated output list of processes
- * @return 0 if successful; -1 otherwise
+ * sls prints sizes, so it still pays one fstatat per printed entry
+ * (relative to the open directory fd, no path re-walk); hidden entries
+ * are skipped before the stat.
  */
-int parse_command(const char* cmdline, struct process* procs[])
+int sls_entry(int dir_fd, const char* name, unsigned char type, void* ctx)
 {
-        /* tokenize commandline (characters -> tokens) */
-        char* tokens[CMDLINE_MAX];
-        read_tokens(cmdline, tokens);
-
-        /* initialize token iterator */
-        char** tok_iter = tokens;
-
-        /* check if there is no command */
-        if (!*tok_iter)
-                return -1;
-
-        /* initialize process index */
-        size_t i = 0;
+        (void)type;
 
-        /* allocate memory for the 1st process */
-        procs[i] = malloc(sizeof(struct process));
+        struct sls_ctx* sls_ctx = ctx;
+        struct stat ent_st;
 
-        /* check malloc failure */
-        if (!procs[i])
-                exit(EXIT_FAILURE);
+        /* skip hidden files before paying for the stat */
+        if (name[0] == '.')
+                return 0;
 
-        /* the input for the 1st process will always be standard input */
-        procs[i]->fd_in = STDIN_FILENO;
+        /* get stat for the current entry */
+        if (fstatat(dir_fd, name, &ent_st, 0)) {
+                perror("sls");
+                return -1;
+        }
 
-        while (true) {
-                if (!(tok_iter = read_argv(tok_iter, procs[i]->argv)))
+        /* flush once the buffer cannot hold another full entry */
+        if (sls_ctx->used + NAME_MAX + 64 > SLS_BUF_SIZE) {
+                if (write(sls_ctx->out_fd, sls_ctx->buf, sls_ctx->used) == -1) {
+                        perror("sls");
                         return -1;
+                }
 
-                if (!is_pipe_token(*tok_iter))
-                        break;
+                sls_ctx->used = 0;
+        }
 
-                procs[++i] = malloc(sizeof(struct process));
+        sls_ctx->used += snprintf(sls_ctx->buf + sls_ctx->used, SLS_BUF_SIZE - sls_ctx->used,
+                                  "%s (%ld bytes)\n", name, ent_st.st_size);
 
-                /* check malloc failure */
-                if (!procs[i])
-                        exit(EXIT_FAILURE);
+        return 0;
+}
 
-                bool redirect_err = (*tok_iter++)[1];
-                if (pipe_procs(procs[i - 1], procs[i], redirect_err))
-                        return -1;
-        }
+/**
+ * @brief list contents in current directory
+ *
+ * the directory is traversed with the bulk getdents64 scanner and the
+ * output is accumulated in a large buffer flushed with a few big writes,
+ * so listing huge directories is bounded by neither per-entry libc round
+ * trips nor per-entry write flushing.
+ *
+ * @param fd the file descriptor the listing is written to
+ * @return 0 if successful; -1 otherwise
+ */
+int sls(int fd)
+{
+        static struct sls_ctx ctx;
 
-        if (is_out_redirect_token(*tok_iter)) {
-                bool redirect_err = (*tok_iter++)[1];
-                char* out_file_path = *tok_iter++;
+        int dir_fd = open("./", O_RDONLY | O_DIRECTORY);
 
-                if (!out_file_path)
-                        return error("no output file");
+        if (dir_fd == -1)
+                return error("cannot open directory");
 
-                if (redirect_proc_out(procs[i], out_file_path, redirect_err))
-                        return -1;
+        ctx.out_fd = fd;
+        ctx.used = 0;
 
-                if (is_pipe_token(*tok_iter))
-                        return error("mislocated output redirection");
-        } else {
-                procs[i]->fd_out = STDOUT_FILENO;
-                procs[i]->fd_err = STDERR_FILENO;
+        if (scan_dir(dir_fd, sls_entry, &ctx)) {
+                (void)close(dir_fd);
+                return -1;
         }
 
-        /* terminate process array */
-        procs[i + 1] = NULL;
+        (void)close(dir_fd);
 
-        free(tokens);
+        /* flush the remaining entries with one final write */
+        if (ctx.used && write(fd, ctx.buf, ctx.used) == -1) {
+                perror("sls");
+                return -1;
+        }
 
         return 0;
 }
 
-/* SECTION 4: Process Execution */
-
 /**
- * @brief close non-standard input, output, and error file descriptors of a process
+ * @brief write exactly `size` bytes to a file descriptor
+ *
+ * @return 0 if successful; -1 on error
  */
-void close_nonstd_fds(const struct process* proc)
+int write_full(int fd, const void* buf, size_t size)
 {
-        if (proc->fd_in != STDIN_FILENO)
-                (void)close(proc->fd_in);
+        const char* p = buf;
 
-        if (proc->fd_out != STDOUT_FILENO)
-                (void)close(proc->fd_out);
+        while (size) {
+                ssize_t n = write(fd, p, size);
 
-        if (proc->fd_err != STDERR_FILENO)
-                (void)close(proc->fd_err);
+                if (n == -1 && errno == EINTR)
+                        continue;
+
+                if (n <= 0)
+                        return -1;
+
+                p += n;
+                size -= n;
+        }
+
+        return 0;
 }
 
 /**
- * @brief execute a process (never returns)
+ * @brief move all bytes from one file descriptor to another
+ *
+ * uses `splice` so the bytes never enter user space when either side is
+ * a pipe; other fd combinations fall back to a plain read/write loop.
+ *
+ * @param in_fd the file descriptor to read from
+ * @param out_fd the file descriptor to write to
+ * @return 0 if successful; -1 otherwise
+ */
+int copy_fd(int in_fd, int out_fd)
+{
+        bool spliced = false;
+
+        for (;;) {
+                ssize_t n = splice(in_fd, NULL, out_fd, NULL, SPLICE_CHUNK_SIZE,
+                                   SPLICE_F_MOVE | SPLICE_F_MORE);
+
+                if (!n)
+                        return 0;
+
+                if (n > 0) {
+                        spliced = true;
+                        continue;
+                }
+
+                if (errno == EINTR)
+                        continue;
+
+                /* neither side is a pipe: fall back to copying */
+                if (errno == EINVAL && !spliced)
+                        break;
+
+                return -1;
+        }
+
+        char buf[INPUT_BUF_SIZE];
+
+        for (;;) {
+                ssize_t n = read(in_fd, buf, sizeof(buf));
+
+                if (!n)
+                        return 0;
+
+                if (n == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -1;
+                }
+
+                if (write_full(out_fd, buf, n))
+                        return -1;
+        }
+}
+
+/**
+ * @brief `scat`: move bytes to the output without forking or copying
+ *
+ * with no operand the input fd is drained into the output fd; with file
+ * operands each file is moved in turn, covering the `cat something`
+ * producer stage of artifact-copy pipelines.
+ *
+ * @param argv the argument list (file operands start at `argv[1]`)
+ * @param fd_in input file descriptor (used when no operand is given)
+ * @param fd_out output file descriptor
+ * @return the exit status (0 on success)
+ */
+int scat_run(char* argv[], int fd_in, int fd_out)
+{
+        if (!argv[1])
+                return copy_fd(fd_in, fd_out) ? 1 : 0;
+
+        for (int i = 1; argv[i]; i++) {
+                int fd = open(argv[i], O_RDONLY);
+
+                if (fd == -1) {
+                        (void)error("cannot open input file");
+                        return 1;
+                }
+
+                if (copy_fd(fd, fd_out)) {
+                        (void)close(fd);
+                        return 1;
+                }
+
+                (void)close(fd);
+        }
+
+        return 0;
+}
+
+/**
+ * @brief `stee`: duplicate the input to the output and to a log file
+ *
+ * between two pipes each chunk is duplicated to the next stage with the
+ * `tee` syscall and then drained into the log file with `splice`, so no
+ * byte enters user space; other fd combinations fall back to a plain
+ * read/write loop feeding both destinations.
+ *
+ * @param argv the argument list (`argv[1]` names the log file)
+ * @param fd_in input file descriptor
+ * @param fd_out output file descriptor
+ * @return the exit status (0 on success)
+ */
+int stee_run(char* argv[], int fd_in, int fd_out)
+{
+        if (!argv[1]) {
+                (void)error("no tee file");
+                return 1;
+        }
+
+        int log_fd = open(argv[1], O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+        if (log_fd == -1) {
+                (void)error("cannot open output file");
+                return 1;
+        }
+
+        bool zero_copy = true;
+
+        for (;;) {
+                ssize_t n = tee(fd_in, fd_out, SPLICE_CHUNK_SIZE, 0);
+
+                if (!n)
+                        break;
+
+                if (n == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        /* both ends must be pipes; nothing is consumed */
+                        /* yet, so falling back to copying is safe */
+                        if (errno == EINVAL) {
+                                zero_copy = false;
+                                break;
+                        }
+
+                        (void)close(log_fd);
+                        return 1;
+                }
+
+                /* consume exactly the duplicated bytes into the log */
+                size_t left = n;
+
+                while (left) {
+                        ssize_t m = splice(fd_in, NULL, log_fd, NULL, left,
+                                           SPLICE_F_MOVE);
+
+                        if (m == -1 && errno == EINTR)
+                                continue;
+
+                        if (m <= 0) {
+                                (void)close(log_fd);
+                                return 1;
+                        }
+
+                        left -= m;
+                }
+        }
+
+        char buf[INPUT_BUF_SIZE];
+
+        while (!zero_copy) {
+                ssize_t n = read(fd_in, buf, sizeof(buf));
+
+                if (!n)
+                        break;
+
+                if (n == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        (void)close(log_fd);
+                        return 1;
+                }
+
+                if (write_full(fd_out, buf, n) || write_full(log_fd, buf, n)) {
+                        (void)close(log_fd);
+                        return 1;
+                }
+        }
+
+        (void)close(log_fd);
+
+        return 0;
+}
+
+/* SECTION 5: Instrumentation Counters */
+
+/**
+ * cheap hot-path event counters.
+ * the shell loop is single-threaded, so plain increments are enough; the
+ * counters cost one add each and are reported by the `stats` built-in or
+ * periodically dumped to `SSHELL_STATS_FILE` for fleet telemetry.
+ */
+static struct {
+        uint64_t lines_read;
+        uint64_t bytes_read;
+        uint64_t commands_parsed;
+        uint64_t plan_hits;
+        uint64_t pipes_created;
+        uint64_t builtin_hits;
+        uint64_t procs_launched;
+        uint64_t vforks;
+        uint64_t spawns;
+        uint64_t forks;
+        uint64_t prefork_launches;
+        uint64_t jobs_started;
+        uint64_t waitpid_ns;
+} stats;
+
+/* file the counters are periodically dumped to (from SSHELL_STATS_FILE) */
+static const char* stats_file;
+
+/* whether SSHELL_STATS_FILE has been looked up yet */
+static bool stats_file_checked;
+
+/**
+ * @brief current monotonic time in nanoseconds
+ */
+uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief write all event counters to a file descriptor
+ */
+void dump_stats(int fd)
+{
+        dprintf(fd, "lines read:      %llu\n", (unsigned long long)stats.lines_read);
+        dprintf(fd, "bytes read:      %llu\n", (unsigned long long)stats.bytes_read);
+        dprintf(fd, "commands parsed: %llu\n", (unsigned long long)stats.commands_parsed);
+        dprintf(fd, "plan hits:       %llu\n", (unsigned long long)stats.plan_hits);
+        dprintf(fd, "pipes created:   %llu\n", (unsigned long long)stats.pipes_created);
+        dprintf(fd, "builtin hits:    %llu\n", (unsigned long long)stats.builtin_hits);
+        dprintf(fd, "procs launched:  %llu\n", (unsigned long long)stats.procs_launched);
+        dprintf(fd, "  via vfork:     %llu\n", (unsigned long long)stats.vforks);
+        dprintf(fd, "  via spawn:     %llu\n", (unsigned long long)stats.spawns);
+        dprintf(fd, "  via fork:      %llu\n", (unsigned long long)stats.forks);
+        dprintf(fd, "  via prefork:   %llu\n", (unsigned long long)stats.prefork_launches);
+        dprintf(fd, "jobs started:    %llu\n", (unsigned long long)stats.jobs_started);
+        dprintf(fd, "waitpid time:    %llu ms\n", (unsigned long long)(stats.waitpid_ns / 1000000));
+}
+
+/**
+ * @brief periodically dump the counters to `SSHELL_STATS_FILE` if set
+ *
+ * called once per completed commandline; the dump itself only happens
+ * every `STATS_DUMP_INTERVAL` commands so the hot path stays cheap.
+ */
+void maybe_dump_stats(void)
+{
+        if (!stats_file_checked) {
+                stats_file = getenv("SSHELL_STATS_FILE");
+                stats_file_checked = true;
+        }
+
+        if (!stats_file || stats.commands_parsed % STATS_DUMP_INTERVAL)
+                return;
+
+        int fd = open(stats_file, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+        if (fd == -1)
+                return;
+
+        dump_stats(fd);
+        (void)close(fd);
+}
+
+/* SECTION 6: Commandline Input */
+
+/* whether stdin is provided by a terminal (set once at startup) */
+static bool input_interactive;
+
+/* read-ahead buffer for batch (non-interactive) mode */
+static char input_buf[INPUT_BUF_SIZE];
+
+/* number of valid bytes in the input buffer */
+static size_t input_len;
+
+/* position of the next unconsumed byte in the input buffer */
+static size_t input_pos;
+
+/* whether end of input has been reached */
+static bool input_eof;
+
+/**
+ * @brief refill the batch input buffer with one large read
+ *
+ * unconsumed bytes are moved to the front of the buffer first so a line
+ * split across two reads is reassembled in place.
+ *
+ * @return the number of bytes read; 0 at end of input
+ */
+size_t refill_input_buf(void)
+{
+        /* move unconsumed bytes to the front of the buffer */
+        if (input_pos) {
+                memmove(input_buf, input_buf + input_pos, input_len - input_pos);
+                input_len -= input_pos;
+                input_pos = 0;
+        }
+
+        ssize_t n = read(STDIN_FILENO, input_buf + input_len, INPUT_BUF_SIZE - input_len);
+
+        if (n == -1)
+                exit_with_sys_err("read");
+
+        input_len += n;
+        stats.bytes_read += n;
+
+        return n;
+}
+
+/* reusable commandline buffer, grown geometrically and kept across lines */
+/* so steady-state reading is allocation-free */
+static char* line_buf;
+static size_t line_cap;
+
+/**
+ * @brief ensure the commandline buffer can hold at least `need` bytes
+ */
+void line_buf_reserve(size_t need)
+{
+        if (need <= line_cap)
+                return;
+
+        while (line_cap < need)
+                line_cap = line_cap ? 2 * line_cap : CMDLINE_MAX;
+
+        line_buf = realloc(line_buf, line_cap);
+
+        /* check realloc failure */
+        if (!line_buf)
+                exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief read the next commandline from standard input
+ *
+ * lines of any length are assembled into a growable buffer that is
+ * reused across iterations, so a line longer than the old fixed
+ * `CMDLINE_MAX` buffer no longer splits into two bogus commands. in
+ * batch mode lines are served from the read-ahead buffer, which is
+ * refilled with large `read` calls, so script-driven throughput is not
+ * bounded by line-at-a-time I/O.
+ *
+ * @return the commandline (valid until the next call); NULL at end of input
+ */
+char* read_cmdline(void)
+{
+        size_t len = 0;
+
+        line_buf_reserve(CMDLINE_MAX);
+
+        if (input_interactive) {
+                /* append fgets chunks until a full line is assembled */
+                while (fgets(line_buf + len, line_cap - len, stdin)) {
+                        len += strlen(line_buf + len);
+
+                        if (len && line_buf[len - 1] == '\n')
+                                break;
+
+                        /* the buffer filled up mid-line: grow and continue */
+                        if (len + 1 == line_cap)
+                                line_buf_reserve(2 * line_cap);
+                }
+
+                if (!len)
+                        return NULL;
+
+                stats.lines_read++;
+                stats.bytes_read += len;
+
+                return line_buf;
+        }
+
+        while (true) {
+                char* start = input_buf + input_pos;
+                size_t avail = input_len - input_pos;
+                char* nl = memchr(start, '\n', avail);
+
+                /* append the available bytes (up to the newline, if any) */
+                size_t chunk = nl ? (size_t)(nl - start) + 1 : avail;
+
+                line_buf_reserve(len + chunk + 1);
+                memcpy(line_buf + len, start, chunk);
+                len += chunk;
+                line_buf[len] = '\0';
+                input_pos += chunk;
+
+                /* serve the line once one is complete or end of input is hit */
+                if (nl || (input_eof && len)) {
+                        stats.lines_read++;
+                        return line_buf;
+                }
+
+                if (input_eof)
+                        return NULL;
+
+                if (!refill_input_buf())
+                        input_eof = true;
+        }
+}
+
+/* SECTION 7: Environment Index */
+
+/* an entry mapping an environment variable name to its current value */
+struct env_index_entry {
+        char name[ENV_NAME_MAX];
+        const char* value;
+};
+
+/* open-addressing hash table over the environment, built lazily on */
+/* first use so `$VAR` expansion avoids a linear `environ` scan per */
+/* reference */
+static struct env_index_entry env_index[ENV_INDEX_SIZE];
+
+/**
+ * @brief insert or update an environment variable in the index
+ *
+ * overlong names and insertions into a full probe chain are skipped;
+ * lookups fall back to `getenv` for them.
+ *
+ * @param name variable name
+ * @param value current value of the variable
+ */
+void env_index_insert(const char* name, const char* value)
+{
+        if (strlen(name) >= ENV_NAME_MAX)
+                return;
+
+        size_t slot = hash_str(name) % ENV_INDEX_SIZE;
+
+        for (size_t i = 0; i < ENV_INDEX_SIZE; i++) {
+                struct env_index_entry* ent = &env_index[(slot + i) % ENV_INDEX_SIZE];
+
+                if (!ent->name[0] || !strcmp(ent->name, name)) {
+                        strcpy(ent->name, name);
+                        ent->value = value;
+                        return;
+                }
+        }
+}
+
+/**
+ * @brief build the environment index on first use
+ *
+ * deferred until the first `$VAR` reference or `export` so invocations
+ * that never touch variables skip the full `environ` walk at startup.
+ */
+void env_index_ensure(void)
+{
+        static bool env_index_ready;
+
+        if (env_index_ready)
+                return;
+
+        env_index_ready = true;
+
+        for (char** e = environ; *e; e++) {
+                const char* eq = strchr(*e, '=');
+
+                if (!eq || (size_t)(eq - *e) >= ENV_NAME_MAX)
+                        continue;
+
+                char name[ENV_NAME_MAX];
+
+                memcpy(name, *e, eq - *e);
+                name[eq - *e] = '\0';
+                env_index_insert(name, eq + 1);
+        }
+}
+
+/**
+ * @brief look up the value of an environment variable
+ *
+ * @param name variable name
+ * @return the value; NULL if the variable is unset
+ */
+const char* env_index_lookup(const char* name)
+{
+        env_index_ensure();
+
+        size_t slot = hash_str(name) % ENV_INDEX_SIZE;
+
+        /* probe linearly; an empty slot ends the probe chain */
+        for (size_t i = 0; i < ENV_INDEX_SIZE; i++) {
+                struct env_index_entry* ent = &env_index[(slot + i) % ENV_INDEX_SIZE];
+
+                if (!ent->name[0])
+                        break;
+
+                if (!strcmp(ent->name, name))
+                        return ent->value;
+        }
+
+        /* not indexed (overlong name or full table): fall back to getenv */
+        return getenv(name);
+}
+
+/* SECTION 8: Commandline Tokenization (Lexical Analysis) */
+
+/**
+ * @brief read the next commandline token from a stream of characters.
+ *
+ * quotes and backslashes group characters that would otherwise split or
+ * start an operator: single quotes take everything literally, double
+ * quotes protect whitespace and operators (with `\"` and `\\` escapes),
+ * and a bare backslash escapes the next character. the quote characters
+ * themselves are not part of the token.
+ *
+ * @param iter the current position of the char iterator
+ * @param buf the buffer to store the token read
+ * @param no_expand set when the token must skip variable expansion
+ * (it contains a single-quoted span or an escaped `$`)
+ * @return
+ * the pointer pointing to the next charater after the end of the token read;
+ * `NULL` when the string terminator is reached.
+ */
+/**
+ * @brief determines if a character needs no special tokenizer handling
+ *
+ * plain characters are everything except whitespace, operators, quotes,
+ * backslashes, and the string terminator.
+ */
+bool is_plain_char(char c)
+{
+        switch (c) {
+        case '\0':
+        case ' ':
+        case '\t':
+        case '|':
+        case '>':
+        case '<':
+        case '&':
+        case '\\':
+        case '\'':
+        case '"':
+                return false;
+
+        default:
+                return true;
+        }
+}
+
+/**
+ * @brief count the leading plain characters of an argument
+ *
+ * this is the tokenizer's inner loop: on SSE2 targets the scan
+ * classifies 16 bytes per step (aligned loads never cross a page, so
+ * reading past the terminator is safe); other targets use the scalar
+ * loop.
+ */
+size_t scan_plain(const char* s)
+{
+        const char* p = s;
+
+#ifdef __SSE2__
+        /* advance to 16-byte alignment for the vector loads */
+        while ((uintptr_t)p & 15) {
+                if (!is_plain_char(*p))
+                        return p - s;
+
+                p++;
+        }
+
+        for (;;) {
+                __m128i chunk = _mm_load_si128((const __m128i*)p);
+                __m128i hits = _mm_cmpeq_epi8(chunk, _mm_setzero_si128());
+
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('|')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('>')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('<')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('&')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\'')));
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')));
+
+                int mask = _mm_movemask_epi8(hits);
+
+                if (mask)
+                        return (p - s) + __builtin_ctz(mask);
+
+                p += 16;
+        }
+#else
+        while (is_plain_char(*p))
+                p++;
+
+        return p - s;
+#endif
+}
+
+const char* read_next_token(const char* iter, char* buf, bool* no_expand, bool* quoted)
+{
+        /* move the iterator to the first non-whitespace character */
+        while (*iter == ' ' || *iter == '\t')
+                iter++;
+
+        /* return NULL when string terminator is reached */
+        if (*iter == '\0')
+                return NULL;
+
+        /* determine the token type by looking at the first character */
+        switch (*iter) {
+        /* the token is an operator */
+        case '>':
+                *buf++ = *iter++;
+
+                if (*iter == '>')
+                        *buf++ = *iter++;
+
+                if (*iter == '&')
+                        *buf++ = *iter++;
+                break;
+
+        case '|':
+                *buf++ = *iter++;
+
+                if (*iter == '&' || *iter == '|')
+                        *buf++ = *iter++;
+                break;
+
+        case '<':
+                *buf++ = *iter++;
+
+                if (iter[0] == '<' && iter[1] == '<') {
+                        *buf++ = *iter++;
+                        *buf++ = *iter++;
+                }
+                break;
+
+        case '&':
+                *buf++ = *iter++;
+
+                if (*iter == '&')
+                        *buf++ = *iter++;
+                break;
+
+        /* the token is an argument */
+        default:
+                while (*iter && *iter != ' ' && *iter != '\t' &&
+                       *iter != '|' && *iter != '>' && *iter != '<' &&
+                       *iter != '&') {
+                        if (*iter == '\\') {
+                                /* a backslash escapes the next character */
+                                *quoted = true;
+                                iter++;
+
+                                if (!*iter)
+                                        break;
+
+                                /* an escaped `$` suppresses expansion */
+                                if (*iter == '$')
+                                        *no_expand = true;
+
+                                *buf++ = *iter++;
+                        } else if (*iter == '\'') {
+                                /* single quotes: everything is literal */
+                                *no_expand = true;
+                                *quoted = true;
+                                iter++;
+
+                                while (*iter && *iter != '\'')
+                                        *buf++ = *iter++;
+
+                                if (*iter)
+                                        iter++;
+                        } else if (*iter == '"') {
+                                /* double quotes: whitespace and operators */
+                                /* lose their meaning */
+                                *quoted = true;
+                                iter++;
+
+                                while (*iter && *iter != '"') {
+                                        if (*iter == '\\' &&
+                                            (iter[1] == '"' || iter[1] == '\\'))
+                                                iter++;
+
+                                        *buf++ = *iter++;
+                                }
+
+                                if (*iter)
+                                        iter++;
+                        } else {
+                                /* bulk-copy the plain span up to the next */
+                                /* special character */
+                                size_t n = scan_plain(iter);
+
+                                memcpy(buf, iter, n);
+                                buf += n;
+                                iter += n;
+                        }
+                }
+                break;
+        }
+
+        /* terminate string */
+        *buf = '\0';
+
+        /* return the current position of the iterator */
+        return iter;
+}
+
+/**
+ * @brief find a control operator occurrence outside quotes and escapes
+ *
+ * mirrors the tokenizer's quoting rules (single quotes literal, double
+ * quotes with `\"`/`\\` escapes, backslash escapes outside quotes) so
+ * an operator inside a quoted argument is not mistaken for a connector.
+ *
+ * @param s the commandline to scan
+ * @param needle the operator to find
+ * @return the first unquoted occurrence; NULL if there is none
+ */
+const char* find_unquoted(const char* s, const char* needle)
+{
+        size_t len = strlen(needle);
+
+        while (*s) {
+                if (*s == '\\' && s[1]) {
+                        s += 2;
+                        continue;
+                }
+
+                if (*s == '\'') {
+                        s++;
+
+                        while (*s && *s != '\'')
+                                s++;
+
+                        if (*s)
+                                s++;
+
+                        continue;
+                }
+
+                if (*s == '"') {
+                        s++;
+
+                        while (*s && *s != '"') {
+                                if (*s == '\\' && (s[1] == '"' || s[1] == '\\'))
+                                        s++;
+
+                                s++;
+                        }
+
+                        if (*s)
+                                s++;
+
+                        continue;
+                }
+
+                if (!strncmp(s, needle, len))
+                        return s;
+
+                s++;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief append bytes to a growing arena string
+ *
+ * @param out the current string
+ * @param len in/out length of the string
+ * @param cap in/out capacity of the string
+ * @param s the bytes to append
+ * @param n the number of bytes to append
+ * @return the string (possibly regrown into a new arena allocation)
+ */
+char* str_append(char* out, size_t* len, size_t* cap, const char* s, size_t n)
+{
+        if (*len + n + 1 > *cap) {
+                /* grow the string geometrically */
+                while (*len + n + 1 > *cap)
+                        *cap *= 2;
+
+                char* grown = arena_alloc(*cap);
+
+                memcpy(grown, out, *len);
+                out = grown;
+        }
+
+        memcpy(out + *len, s, n);
+        *len += n;
+
+        return out;
+}
+
+/**
+ * @brief determines if a character can be part of a variable name
+ */
+bool is_name_char(char c)
+{
+        return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+               (c >= '0' && c <= '9');
+}
+
+/**
+ * @brief expand `$VAR` and `${VAR}` references in a token
+ *
+ * references resolve through the environment index instead of a linear
+ * `environ` scan per reference; an unset variable expands to nothing
+ * and a `$` that starts no valid reference stays literal.
+ *
+ * @param token the token text
+ * @return the expanded arena-allocated string; the token itself when it
+ * carries no references
+ */
+char* expand_vars(char* token)
+{
+        if (!strchr(token, '$'))
+                return token;
+
+        size_t cap = 2 * strlen(token) + 2;
+        size_t len = 0;
+        char* out = arena_alloc(cap);
+
+        for (const char* p = token; *p;) {
+                if (*p != '$') {
+                        out = str_append(out, &len, &cap, p++, 1);
+                        continue;
+                }
+
+                const char* name;
+                size_t name_len;
+                const char* after;
+
+                if (p[1] == '{') {
+                        const char* close = strchr(p + 2, '}');
+
+                        /* an unterminated `${` stays literal */
+                        if (!close) {
+                                out = str_append(out, &len, &cap, p++, 1);
+                                continue;
+                        }
+
+                        name = p + 2;
+                        name_len = close - name;
+                        after = close + 1;
+                } else {
+                        name = p + 1;
+                        name_len = 0;
+
+                        /* a name starts with a letter or `_`, never a digit */
+                        if (is_name_char(name[0]) &&
+                            (name[0] < '0' || name[0] > '9'))
+                                while (is_name_char(name[name_len]))
+                                        name_len++;
+
+                        /* a `$` that starts no name stays literal */
+                        if (!name_len) {
+                                out = str_append(out, &len, &cap, p++, 1);
+                                continue;
+                        }
+
+                        after = name + name_len;
+                }
+
+                char* name_buf = arena_alloc(name_len + 1);
+
+                memcpy(name_buf, name, name_len);
+                name_buf[name_len] = '\0';
+
+                const char* value = env_index_lookup(name_buf);
+
+                if (value)
+                        out = str_append(out, &len, &cap, value, strlen(value));
+
+                p = after;
+        }
+
+        out[len] = '\0';
+
+        return out;
+}
+
+/**
+ * @brief read a commandline into tokens
+ *
+ * a single arena buffer holds every token, NUL-separated, and `tokens`
+ * points into it: `read_next_token` writes each token straight into the
+ * buffer, replacing the old per-token malloc + strcpy (two copies and an
+ * allocation per token) with one copy and zero allocations. tokens are
+ * no longer capped at `TOKEN_MAX`, so overlong tokens cannot overflow.
+ *
+ * @param cmdline the string tokens should be read from
+ * @param quoted_out output array of per-token flags, parallel to the
+ * token list: set when a token was built from quotes or escapes (its
+ * glob characters must stay literal)
+ * @return null-terminated arena-allocated list of tokens read from the string
+ */
+char** read_tokens(const char* cmdline, const bool** quoted_out)
+{
+        size_t len = strlen(cmdline);
+
+        /* every token spans at least one character, so the commandline */
+        /* length bounds the token count */
+        char** tokens = arena_alloc((len + 1) * sizeof(char*));
+        bool* quoted_flags = arena_alloc((len + 1) * sizeof(bool));
+        char** tok = tokens;
+
+        /* each token is at most one byte (its NUL) longer than its source */
+        /* text, so twice the commandline length bounds the whole buffer */
+        char* buf = arena_alloc(2 * len + 2);
+
+        while (true) {
+                bool no_expand = false;
+                bool quoted = false;
+
+                if (!(cmdline = read_next_token(cmdline, buf, &no_expand, &quoted)))
+                        break;
+
+                char* token = no_expand ? buf : expand_vars(buf);
+
+                buf += strlen(buf) + 1;
+
+                /* a reference to an unset variable expands away entirely, */
+                /* but an explicitly quoted empty string ('' or \"\") must */
+                /* survive as an empty argument */
+                if (!token[0] && !quoted)
+                        continue;
+
+                quoted_flags[tok - tokens] = quoted;
+                *tok++ = token;
+        }
+
+        /* terminate token array */
+        *tok = NULL;
+        *quoted_out = quoted_flags;
+
+        return tokens;
+}
+
+/**
+ * @brief determines if the token is an argument
+ */
+bool is_arg(const char* token)
+{
+        return token && token[0] != '>' && token[0] != '<' &&
+               token[0] != '|' && token[0] != '&';
+}
+
+/**
+ * @brief determines if the token is a pipe token
+ */
+bool is_pipe_token(const char* token)
+{
+        return token && token[0] == '|' && token[1] != '|';
+}
+
+/**
+ * @brief determines if the token is an output redirect token
+ */
+bool is_out_redirect_token(const char* token)
+{
+        return token && token[0] == '>';
+}
+
+/**
+ * @brief determines if the token is an input redirect token
+ */
+bool is_in_redirect_token(const char* token)
+{
+        return token && token[0] == '<';
+}
+
+/**
+ * @brief determines if the token is a background token
+ */
+bool is_background_token(const char* token)
+{
+        return token && token[0] == '&' && !token[1];
+}
+
+/* SECTION 9: Commandline Parsing */
+
+/* a directory scan memoized for the duration of one parse, so several */
+/* glob patterns over the same directory scan it only once */
+struct scan_cache_entry {
+        const char* prefix;
+        char** names;
+        size_t count;
+};
+
+static struct scan_cache_entry scan_cache[SCAN_CACHE_SIZE];
+static size_t num_scan_cache;
+
+/* growing name list filled by the directory scan callback */
+struct collect_ctx {
+        char** names;
+        size_t count;
+        size_t cap;
+};
+
+/**
+ * @brief directory scan callback that collects every entry name
+ */
+int collect_entry(int dir_fd, const char* name, unsigned char type, void* ctx)
+{
+        struct collect_ctx* collect = ctx;
+
+        (void)dir_fd;
+        (void)type;
+
+        if (collect->count == collect->cap) {
+                /* grow the name list geometrically */
+                size_t cap = collect->cap ? 2 * collect->cap : 64;
+                char** grown = arena_alloc(cap * sizeof(char*));
+
+                memcpy(grown, collect->names, collect->count * sizeof(char*));
+                collect->names = grown;
+                collect->cap = cap;
+        }
+
+        char* copy = arena_alloc(strlen(name) + 1);
+
+        strcpy(copy, name);
+        collect->names[collect->count++] = copy;
+
+        return 0;
+}
+
+/**
+ * @brief compare two entry names (qsort callback)
+ */
+int cmp_name(const void* a, const void* b)
+{
+        return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+ * @brief list a directory's entry names, memoized per parse
+ *
+ * @param prefix the directory part of a glob pattern, including the
+ * trailing `/` ("" scans the working directory)
+ * @param count_out receives the number of entries
+ * @return the sorted arena-allocated entry names; NULL if the directory
+ * cannot be scanned
+ */
+char** scan_dir_cached(const char* prefix, size_t* count_out)
+{
+        for (size_t i = 0; i < num_scan_cache; i++) {
+                if (!strcmp(scan_cache[i].prefix, prefix)) {
+                        *count_out = scan_cache[i].count;
+                        return scan_cache[i].names;
+                }
+        }
+
+        int dir_fd = open(prefix[0] ? prefix : ".", O_RDONLY | O_DIRECTORY);
+
+        if (dir_fd == -1)
+                return NULL;
+
+        struct collect_ctx collect = { 0 };
+
+        if (scan_dir(dir_fd, collect_entry, &collect)) {
+                (void)close(dir_fd);
+                return NULL;
+        }
+
+        (void)close(dir_fd);
+
+        /* expansions are deterministic: names are matched in sorted order */
+        qsort(collect.names, collect.count, sizeof(char*), cmp_name);
+
+        if (num_scan_cache < SCAN_CACHE_SIZE) {
+                scan_cache[num_scan_cache].prefix = prefix;
+                scan_cache[num_scan_cache].names = collect.names;
+                scan_cache[num_scan_cache].count = collect.count;
+                num_scan_cache++;
+        }
+
+        *count_out = collect.count;
+
+        return collect.names;
+}
+
+/**
+ * @brief match a name against a glob pattern (`*`, `?`, and `[...]`)
+ */
+bool glob_match(const char* pattern, const char* name)
+{
+        while (*pattern) {
+                switch (*pattern) {
+                case '*':
+                        /* collapse consecutive stars */
+                        while (*pattern == '*')
+                                pattern++;
+
+                        if (!*pattern)
+                                return true;
+
+                        /* try every possible tail the star could leave */
+                        for (; *name; name++)
+                                if (glob_match(pattern, name))
+                                        return true;
+
+                        return false;
+
+                case '?':
+                        if (!*name)
+                                return false;
+
+                        pattern++;
+                        name++;
+                        break;
+
+                case '[': {
+                        bool negate = pattern[1] == '!' || pattern[1] == '^';
+                        const char* set = pattern + (negate ? 2 : 1);
+                        bool matched = false;
+
+                        if (!*name)
+                                return false;
+
+                        /* a leading `]` is a literal member of the set */
+                        for (bool first = true; *set && (*set != ']' || first);
+                             first = false, set++) {
+                                if (set[1] == '-' && set[2] && set[2] != ']') {
+                                        matched |= *name >= set[0] && *name <= set[2];
+                                        set += 2;
+                                } else {
+                                        matched |= *name == *set;
+                                }
+                        }
+
+                        /* an unterminated set matches nothing */
+                        if (*set != ']')
+                                return false;
+
+                        if (matched == negate)
+                                return false;
+
+                        pattern = set + 1;
+                        name++;
+                        break;
+                }
+
+                default:
+                        if (*pattern != *name)
+                                return false;
+
+                        pattern++;
+                        name++;
+                        break;
+                }
+        }
+
+        return !*name;
+}
+
+/**
+ * @brief append one argument to a process's argument list
+ *
+ * the argument list starts in the process's inline storage (enough for
+ * the common small case) and is regrown geometrically from the arena
+ * when a command carries more than `ARG_MAX` arguments.
+ */
+void argv_append(struct process* proc, size_t* num, size_t* cap, char* arg)
+{
+        if (*num == *cap) {
+                /* grow the argument list geometrically */
+                char** grown = arena_alloc((2 * *cap + 1) * sizeof(char*));
+
+                memcpy(grown, proc->argv, *num * sizeof(char*));
+                proc->argv = grown;
+                *cap *= 2;
+        }
+
+        proc->argv[(*num)++] = arg;
+}
+
+/**
+ * @brief expand a glob pattern into a process's argument list
+ *
+ * only the name part of the pattern may carry glob characters (the
+ * directory part is taken literally); matches are appended in sorted
+ * order, and hidden entries only match a pattern that starts with `.`.
+ *
+ * @param pattern the glob pattern token
+ * @param proc the process whose argument list is extended
+ * @param num in/out count of arguments
+ * @param cap in/out capacity of the argument list
+ * @return the number of matches appended (0 leaves the token literal)
+ */
+size_t expand_glob(char* pattern, struct process* proc, size_t* num, size_t* cap)
+{
+        char* slash = strrchr(pattern, '/');
+        const char* prefix = "";
+        const char* name_pattern = pattern;
+
+        if (slash) {
+                size_t prefix_len = slash - pattern + 1;
+                char* copy = arena_alloc(prefix_len + 1);
+
+                memcpy(copy, pattern, prefix_len);
+                copy[prefix_len] = '\0';
+                prefix = copy;
+                name_pattern = slash + 1;
+
+                /* glob characters in the directory part are not expanded */
+                if (strpbrk(prefix, "*?["))
+                        return 0;
+        }
+
+        size_t count;
+        char** names = scan_dir_cached(prefix, &count);
+
+        if (!names)
+                return 0;
+
+        size_t matched = 0;
+
+        for (size_t i = 0; i < count; i++) {
+                if (names[i][0] == '.' && name_pattern[0] != '.')
+                        continue;
+
+                if (!glob_match(name_pattern, names[i]))
+                        continue;
+
+                char* arg = arena_alloc(strlen(prefix) + strlen(names[i]) + 1);
+
+                strcpy(arg, prefix);
+                strcat(arg, names[i]);
+                argv_append(proc, num, cap, arg);
+                matched++;
+        }
+
+        return matched;
+}
+
+/**
+ * @brief read command arguments from a stream of tokens
+ *
+ * the argument list starts in the process's inline storage (enough for
+ * the common small case) and is regrown geometrically from the arena
+ * when a command carries more than `ARG_MAX` arguments.
+ *
+ * @param tokens start of the token list (to index the quoted flags)
+ * @param token_iter current position of token iterator
+ * @param quoted per-token flags from read_tokens; a quoted token's glob
+ * characters stay literal
+ * @param proc the process whose argument list is read
+ * @return
+ * the new position of the token iterator pointing to the next token after the last argument read;
+ * `NULL` if there is no argument.
+ */
+char** read_argv(char** tokens, char** token_iter, const bool* quoted,
+                 struct process* proc)
+{
+        size_t i = 0;
+        size_t cap = ARG_MAX;
+
+        proc->argv = proc->argv_inline;
+
+        while (is_arg(*token_iter)) {
+                bool literal = quoted[token_iter - tokens];
+                char* token = *token_iter++;
+
+                /* an unquoted token with glob characters expands to its */
+                /* matches; a pattern that matches nothing stays literal */
+                if (!literal && strpbrk(token, "*?[") &&
+                    expand_glob(token, proc, &i, &cap))
+                        continue;
+
+                argv_append(proc, &i, &cap, token);
+        }
+
+        proc->argv[i] = NULL;
+
+        if (!proc->argv[0]) {
+                (void)error("missing command");
+                return NULL;
+        }
+
+        return token_iter;
+}
+
+/* pipe buffer size requested via SSHELL_PIPE_SIZE (0 keeps the default) */
+static long pipe_size;
+static bool pipe_size_checked;
+
+/**
+ * @brief create a pipe between two processes
+ *
+ * @param src source process that will write to the pipe
+ * @param dest destination process that will read from the pipe
+ * @param redirect_err whether the error of the source process will be redirected to the pipe
+ * @return 0 if pipe creation is successful; -1 otherwise
+ */
+int pipe_procs(struct process* src, struct process* dest, bool redirect_err)
+{
+        int pipe_fds[2];
+
+        /* O_CLOEXEC: a `&&&` group parses every member (and thus creates */
+        /* every pipe) before any member launches, so exec'd children must */
+        /* not inherit the pipe ends of other members (dup2 onto the */
+        /* standard fds clears the flag for the ends a child does use) */
+        if (pipe2(pipe_fds, O_CLOEXEC))
+                exit_with_sys_err("pipe2");
+
+        stats.pipes_created++;
+
+        /* read the pipe buffer size knob once (0 keeps the kernel default) */
+        if (!pipe_size_checked) {
+                const char* size_str = getenv("SSHELL_PIPE_SIZE");
+
+                pipe_size = size_str ? atol(size_str) : 0;
+                pipe_size_checked = true;
+        }
+
+        /* grow the pipe buffer so high-throughput pipelines context-switch */
+        /* less often; sizing is best effort (the kernel caps unprivileged */
+        /* sizes at /proc/sys/fs/pipe-max-size) */
+        if (pipe_size > 0)
+                (void)fcntl(pipe_fds[1], F_SETPIPE_SZ, pipe_size);
+
+        src->fd_out = pipe_fds[1];
+        src->fd_err = redirect_err ? pipe_fds[1] : STDERR_FILENO;
+        dest->fd_in = pipe_fds[0];
+
+        return 0;
+}
+
+/**
+ * @brief redirect the output of a process to a file
+ *
+ * @param proc the process for which the output needs to be redirected
+ * @param out_file_path the path of the output file
+ * @param redirect_err whether the error of the process should be redirected to the output file
+ * @param append whether writes append to the file (`>>`) instead of truncating it (`>`)
+ * @return 0 if successful; -1 otherwise
+ */
+int redirect_proc_out(struct process* proc, const char* out_file_path, bool redirect_err,
+                      bool append)
+{
+        /* if the file already exists, truncate the length to 0 (or keep it */
+        /* and append for `>>`); if the file does not exists, create it with */
+        /* permission rw-r--r--. */
+        int fd = open(out_file_path, O_CREAT | O_WRONLY | (append ? O_APPEND : O_TRUNC), 0644);
+
+        if (fd == -1)
+                return error("cannot open output file");
+
+        proc->fd_out = fd;
+        proc->fd_err = redirect_err ? fd : STDERR_FILENO;
+
+        return 0;
+}
+
+/**
+ * @brief redirect the input of a process to a file
+ *
+ * @param proc the process for which the input needs to be redirected
+ * @param in_file_path the path of the input file
+ * @return 0 if successful; -1 otherwise
+ */
+int redirect_proc_in(struct process* proc, const char* in_file_path)
+{
+        int fd = open(in_file_path, O_RDONLY);
+
+        if (fd == -1)
+                return error("cannot open input file");
+
+        proc->fd_in = fd;
+
+        return 0;
+}
+
+/**
+ * @brief feed a here-string to a process through a pipe
+ *
+ * the string and a trailing newline are written into the pipe up front
+ * (before any child is launched), eliminating the `cat file |` fork and
+ * data copy. the pipe buffer is grown to fit when the string is larger
+ * than the default capacity; a string beyond the kernel's pipe size cap
+ * is refused rather than blocking the shell on the write.
+ *
+ * @param proc the process for which the input needs to be fed
+ * @param str the here-string
+ * @return 0 if successful; -1 otherwise
+ */
+int redirect_proc_in_string(struct process* proc, const char* str)
+{
+        size_t len = strlen(str);
+        int pipe_fds[2];
+
+        /* O_CLOEXEC for the same reason as pipe_procs: the read end must */
+        /* not leak into exec'd children of other parallel-group members */
+        if (pipe2(pipe_fds, O_CLOEXEC))
+                exit_with_sys_err("pipe2");
+
+        stats.pipes_created++;
+
+        /* grow the pipe buffer when the default is too small (the kernel */
+        /* caps unprivileged sizes at /proc/sys/fs/pipe-max-size) */
+        long cap = fcntl(pipe_fds[1], F_GETPIPE_SZ);
+
+        if (cap != -1 && (size_t)cap < len + 1) {
+                (void)fcntl(pipe_fds[1], F_SETPIPE_SZ, len + 1);
+                cap = fcntl(pipe_fds[1], F_GETPIPE_SZ);
+        }
+
+        if (cap != -1 && (size_t)cap < len + 1) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+
+                return error("here-string too large");
+        }
+
+        if (write_full(pipe_fds[1], str, len) ||
+            write_full(pipe_fds[1], "\n", 1))
+                exit_with_sys_err("write");
+
+        close(pipe_fds[1]);
+        proc->fd_in = pipe_fds[0];
+
+        return 0;
+}
+
+/* a word found by the plan scanner: an unterminated span of the commandline */
+struct plan_word {
+        const char* start;
+        size_t len;
+};
+
+/**
+ * a memoized parse plan: the structure of a commandline with the word
+ * text abstracted away, so lines that differ only in their arguments
+ * (the common case for re-submitted command templates) share one entry.
+ * a slot with skeleton 0 is empty.
+ */
+struct parse_plan {
+        uint64_t skeleton;
+        size_t num_procs;
+        size_t argc[PROCESS_MAX];
+        /* pipe i connects process i-1 to process i (`|&` joins stderr) */
+        bool pipe_err[PROCESS_MAX];
+        /* 0 none, '<' file, 'h' here-string */
+        char in_redirect;
+        /* 0 none, 't' truncate, 'a' append */
+        char out_redirect;
+        bool out_err;
+        bool background;
+};
+
+/* open-addressing hash table over memoized parse plans */
+static struct parse_plan plan_cache[PLAN_CACHE_SIZE];
+
+/**
+ * @brief scan a commandline into its structural skeleton and word spans
+ *
+ * one pass over the characters computes a hash of the line's structure
+ * (operators and word positions, but not word text) and collects the
+ * word spans in stream order. only plain lines qualify: anything that
+ * needs the full tokenizer (quotes, escapes, `$` expansion, glob
+ * characters) or exceeds the fixed plan shape makes the scan bail to
+ * the regular parse path.
+ *
+ * @param cmdline commandline
+ * @param skeleton_out output structural hash
+ * @param words output array of at least `PLAN_WORD_MAX` word spans
+ * @param plan output plan describing the scanned structure
+ * @return whether the line is plan-cacheable
+ */
+bool plan_scan(const char* cmdline, uint64_t* skeleton_out,
+               struct plan_word words[], struct parse_plan* plan)
+{
+        enum {
+                WANT_ARGS,      /* collecting a process's arguments */
+                WANT_IN_FILE,   /* the input redirect operand */
+                WANT_OUT_FILE,  /* the output redirect operand */
+                WANT_POST_IN,   /* after the input operand: `|`, `>`, `&` */
+                WANT_POST_OUT,  /* after the output operand: `&` only */
+                WANT_END,       /* after `&`: nothing may follow */
+        } state = WANT_ARGS;
+
+        const char* p = cmdline;
+        uint64_t h = 5381;
+        size_t nw = 0;
+        size_t proc = 0;
+        size_t argc = 0;
+
+        memset(plan, 0, sizeof(*plan));
+
+        while (*p) {
+                char c = *p;
+
+                if (c == ' ' || c == '\t') {
+                        p++;
+                        continue;
+                }
+
+                if (c == '|') {
+                        if (state != WANT_ARGS && state != WANT_POST_IN)
+                                return false;
+
+                        if (state == WANT_ARGS && !argc)
+                                return false;
+
+                        if (proc + 1 == PROCESS_MAX)
+                                return false;
+
+                        plan->argc[proc] = argc;
+                        h = h * 33 + '|';
+                        p++;
+
+                        if (*p == '&') {
+                                plan->pipe_err[proc + 1] = true;
+                                h = h * 33 + '&';
+                                p++;
+                        }
+
+                        proc++;
+                        argc = 0;
+                        state = WANT_ARGS;
+                        continue;
+                }
+
+                if (c == '<') {
+                        /* input redirection only on the first process */
+                        if (state != WANT_ARGS || proc || !argc)
+                                return false;
+
+                        h = h * 33 + '<';
+                        p++;
+
+                        if (p[0] == '<' && p[1] == '<') {
+                                plan->in_redirect = 'h';
+                                h = h * 33 + '<';
+                                h = h * 33 + '<';
+                                p += 2;
+                        } else if (*p == '<') {
+                                return false;
+                        } else {
+                                plan->in_redirect = '<';
+                        }
+
+                        state = WANT_IN_FILE;
+                        continue;
+                }
+
+                if (c == '>') {
+                        if (state != WANT_ARGS && state != WANT_POST_IN)
+                                return false;
+
+                        if (state == WANT_ARGS && !argc)
+                                return false;
+
+                        h = h * 33 + '>';
+                        p++;
+
+                        bool append = *p == '>';
+
+                        if (append) {
+                                h = h * 33 + '>';
+                                p++;
+                        }
+
+                        if (*p == '>')
+                                return false;
+
+                        if (*p == '&') {
+                                plan->out_err = true;
+                                h = h * 33 + '&';
+                                p++;
+                        }
+
+                        plan->out_redirect = append ? 'a' : 't';
+                        state = WANT_OUT_FILE;
+                        continue;
+                }
+
+                if (c == '&') {
+                        if (state != WANT_ARGS && state != WANT_POST_IN &&
+                            state != WANT_POST_OUT)
+                                return false;
+
+                        if (state == WANT_ARGS && !argc)
+                                return false;
+
+                        if (p[1] == '&')
+                                return false;
+
+                        plan->background = true;
+                        h = h * 33 + '&';
+                        p++;
+                        state = WANT_END;
+                        continue;
+                }
+
+                /* a word */
+                if (state == WANT_POST_IN || state == WANT_POST_OUT ||
+                    state == WANT_END)
+                        return false;
+
+                if (nw == PLAN_WORD_MAX)
+                        return false;
+
+                words[nw].start = p;
+
+                while (is_plain_char(*p)) {
+                        /* glob and `$` expansion need the full parse */
+                        if (strchr("$*?[", *p))
+                                return false;
+
+                        p++;
+                }
+
+                /* a quote or backslash needs the full tokenizer */
+                if (*p && strchr("'\"\\", *p))
+                        return false;
+
+                words[nw].len = p - words[nw].start;
+                nw++;
+                h = h * 33 + 'w';
+
+                if (state == WANT_IN_FILE) {
+                        state = WANT_POST_IN;
+                } else if (state == WANT_OUT_FILE) {
+                        state = WANT_POST_OUT;
+                } else {
+                        /* keep the argument list in the inline storage */
+                        if (++argc == ARG_MAX)
+                                return false;
+                }
+        }
+
+        /* a dangling operator or an empty (segment of a) line bails */
+        if (state == WANT_IN_FILE || state == WANT_OUT_FILE)
+                return false;
+
+        if (state == WANT_ARGS && !argc)
+                return false;
+
+        plan->argc[proc] = argc;
+        plan->num_procs = proc + 1;
+
+        /* skeleton 0 marks an empty cache slot */
+        *skeleton_out = h ? h : 1;
+
+        return true;
+}
+
+/**
+ * @brief copy a word span into a NUL-terminated arena string
+ */
+char* plan_word_copy(const struct plan_word* word)
+{
+        char* copy = arena_alloc(word->len + 1);
+
+        memcpy(copy, word->start, word->len);
+        copy[word->len] = '\0';
+
+        return copy;
+}
+
+/**
+ * @brief instantiate a parse plan with the words of the current line
+ *
+ * builds the process list the way parse_command would, but from the
+ * memoized structure: argv slots are re-pointed at the new words and
+ * only the per-run work (pipes, redirect opens) is redone.
+ *
+ * @param plan the plan to instantiate
+ * @param words the word spans of the current line, in stream order
+ * @param procs_out output pointer to the null-terminated arena-allocated list of processes
+ * @param background output flag set when the plan ends with `&`
+ * @return 0 if successful; -1 otherwise
+ */
+int plan_execute(const struct parse_plan* plan, const struct plan_word words[],
+                 struct process*** procs_out, bool* background)
+{
+        struct process** procs = arena_alloc((plan->num_procs + 1) * sizeof(struct process*));
+        size_t w = 0;
+
+        for (size_t i = 0; i < plan->num_procs; i++) {
+                struct process* proc = arena_alloc(sizeof(struct process));
+
+                procs[i] = proc;
+                proc->argv = proc->argv_inline;
+
+                for (size_t j = 0; j < plan->argc[i]; j++)
+                        proc->argv[j] = plan_word_copy(&words[w++]);
+
+                proc->argv[plan->argc[i]] = NULL;
+
+                /* the input redirect operand follows the first argv */
+                if (!i) {
+                        proc->fd_in = STDIN_FILENO;
+
+                        if (plan->in_redirect) {
+                                char* in_operand = plan_word_copy(&words[w++]);
+
+                                if (plan->in_redirect == 'h' ?
+                                    redirect_proc_in_string(proc, in_operand) :
+                                    redirect_proc_in(proc, in_operand))
+                                        return -1;
+                        }
+                } else if (pipe_procs(procs[i - 1], proc, plan->pipe_err[i])) {
+                        return -1;
+                }
+        }
+
+        struct process* last = procs[plan->num_procs - 1];
+
+        if (plan->out_redirect) {
+                if (redirect_proc_out(last, plan_word_copy(&words[w]),
+                                      plan->out_err, plan->out_redirect == 'a'))
+                        return -1;
+        } else {
+                last->fd_out = STDOUT_FILENO;
+                last->fd_err = STDERR_FILENO;
+        }
+
+        if (plan->background)
+                *background = true;
+
+        procs[plan->num_procs] = NULL;
+        *procs_out = procs;
+        stats.commands_parsed++;
+
+        return 0;
+}
+
+/**
+ * @brief try to parse a commandline through the plan cache
+ *
+ * structurally familiar lines skip read_tokens/read_argv entirely: the
+ * one-pass scan yields the skeleton hash and the word spans, and the
+ * memoized plan is replayed with the argv slots re-pointed at them.
+ *
+ * @param cmdline commandline
+ * @param procs_out output pointer to the null-terminated arena-allocated list of processes
+ * @param background output flag set when the commandline ends with `&`
+ * @return 1 if planned successfully; -1 on a replay error; 0 if the
+ * line is not plan-cacheable (the caller must fall back to the full parse)
+ */
+int plan_parse(const char* cmdline, struct process*** procs_out, bool* background)
+{
+        struct plan_word words[PLAN_WORD_MAX];
+        struct parse_plan scanned;
+        uint64_t skeleton;
+
+        if (!plan_scan(cmdline, &skeleton, words, &scanned))
+                return 0;
+
+        scanned.skeleton = skeleton;
+
+        size_t slot = skeleton % PLAN_CACHE_SIZE;
+        const struct parse_plan* plan = &scanned;
+
+        /* probe linearly; an empty slot ends the probe chain (and a full */
+        /* chain replays the scanned plan without memoizing it) */
+        for (size_t i = 0; i < PLAN_CACHE_SIZE; i++) {
+                struct parse_plan* ent = &plan_cache[(slot + i) % PLAN_CACHE_SIZE];
+
+                if (!ent->skeleton) {
+                        *ent = scanned;
+                        plan = ent;
+                        break;
+                }
+
+                /* compare the whole structure, not just the hash: a */
+                /* colliding entry must not be replayed against this */
+                /* line's words (both sides are memset, so padding is 0) */
+                if (!memcmp(ent, &scanned, sizeof(scanned))) {
+                        plan = ent;
+                        stats.plan_hits++;
+                        break;
+                }
+        }
+
+        return plan_execute(plan, words, procs_out, background) ? -1 : 1;
+}
+
+/**
+ * @brief parse a commandline into a list of processes
+ * each with an argument list and file descriptors for input, output, and error
+ *
+ * @param cmdline commandline
+ * @param procs_out output pointer to the null-terminated arena-allocated list of processes
+ * @param background output flag set when the commandline ends with `&`
+ * @return 0 if successful; -1 otherwise
+ */
+int parse_command(const char* cmdline, struct process*** procs_out, bool* background)
+{
+        /* structurally familiar plain lines replay a memoized parse plan */
+        int planned = plan_parse(cmdline, procs_out, background);
+
+        if (planned)
+                return planned < 0 ? -1 : 0;
+
+        /* tokenize commandline (characters -> tokens) */
+        const bool* quoted;
+        char** tokens = read_tokens(cmdline, &quoted);
+
+        /* cached directory scans are arena-backed and thus only valid */
+        /* within one parse */
+        num_scan_cache = 0;
+
+        /* initialize token iterator */
+        char** tok_iter = tokens;
+
+        /* check if there is no command */
+        if (!*tok_iter)
+                return -1;
+
+        /* initialize process index */
+        size_t i = 0;
+
+        /* the process list starts small and is regrown geometrically for */
+        /* pipelines deeper than `PROCESS_MAX` stages */
+        size_t cap = PROCESS_MAX;
+        struct process** procs = arena_alloc((cap + 1) * sizeof(struct process*));
+
+        /* allocate memory for the 1st process */
+        procs[i] = arena_alloc(sizeof(struct process));
+
+        /* the input for the 1st process will always be standard input */
+        procs[i]->fd_in = STDIN_FILENO;
+
+        while (true) {
+                if (!(tok_iter = read_argv(tokens, tok_iter, quoted, procs[i])))
+                        return -1;
+
+                /* only the first process can have its input redirected */
+                if (is_in_redirect_token(*tok_iter)) {
+                        if (i)
+                                return error("mislocated input redirection");
+
+                        const char* redirect = *tok_iter++;
+                        char* in_operand = *tok_iter++;
+
+                        if (!in_operand)
+                                return error("no input file");
+
+                        /* `<<<` feeds a here-string; `<` opens a file */
+                        if (redirect[1] ?
+                            redirect_proc_in_string(procs[0], in_operand) :
+                            redirect_proc_in(procs[0], in_operand))
+                                return -1;
+                }
+
+                if (!is_pipe_token(*tok_iter))
+                        break;
+
+                if (i + 1 == cap) {
+                        /* grow the process list geometrically */
+                        struct process** grown = arena_alloc((2 * cap + 1) * sizeof(struct process*));
+
+                        memcpy(grown, procs, (i + 1) * sizeof(struct process*));
+                        procs = grown;
+                        cap *= 2;
+                }
+
+                procs[++i] = arena_alloc(sizeof(struct process));
+
+                bool redirect_err = (*tok_iter++)[1];
+                if (pipe_procs(procs[i - 1], procs[i], redirect_err))
+                        return -1;
+        }
+
+        if (is_out_redirect_token(*tok_iter)) {
+                const char* redirect = *tok_iter++;
+                bool append = redirect[1] == '>';
+                bool redirect_err = append ? redirect[2] : redirect[1];
+                char* out_file_path = *tok_iter++;
+
+                if (!out_file_path)
+                        return error("no output file");
+
+                if (redirect_proc_out(procs[i], out_file_path, redirect_err, append))
+                        return -1;
+
+                if (is_pipe_token(*tok_iter))
+                        return error("mislocated output redirection");
+        } else {
+                procs[i]->fd_out = STDOUT_FILENO;
+                procs[i]->fd_err = STDERR_FILENO;
+        }
+
+        /* a trailing `&` makes the commandline a background job */
+        if (is_background_token(*tok_iter)) {
+                *background = true;
+                tok_iter++;
+
+                if (*tok_iter)
+                        return error("mislocated background sign");
+        }
+
+        /* any token left over here (e.g. arguments after a redirect */
+        /* operand) would be silently dropped: reject the line instead */
+        if (*tok_iter)
+                return error("mislocated token");
+
+        /* terminate process array */
+        procs[i + 1] = NULL;
+
+        *procs_out = procs;
+        stats.commands_parsed++;
+
+        return 0;
+}
+
+/* SECTION 10: Prefork Helper Pool */
+
+/* a dormant helper child blocked on its control socket */
+/* (a slot with sock == -1 is empty) */
+struct prefork_helper {
+        pid_t pid;
+        int sock;
+};
+
+/* pool of dormant helpers (enabled via SSHELL_PREFORK) */
+static struct prefork_helper prefork_pool[PREFORK_MAX];
+
+/* configured pool size (0 disables the pool) */
+static size_t prefork_size;
+
+/**
+ * @brief helper child: wait for one job on the control socket and exec it
+ *
+ * the message carries the resolved path and argv (NUL separated) plus
+ * the three standard file descriptors via SCM_RIGHTS; the helper wires
+ * them up with dup2 and execs. the socket closing without a message
+ * means the shell exited, so the helper just leaves.
+ *
+ * @param sock the helper's end of the control socket
+ */
+void prefork_helper_main(int sock)
+{
+        char buf[PREFORK_MSG_MAX];
+        union {
+                struct cmsghdr align;
+                char data[CMSG_SPACE(3 * sizeof(int))];
+        } cmsg_buf;
+
+        struct iovec iov = { buf, sizeof(buf) };
+        struct msghdr msg = { 0 };
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsg_buf.data;
+        msg.msg_controllen = sizeof(cmsg_buf.data);
+
+        ssize_t n = recvmsg(sock, &msg, 0);
+
+        /* retry a signal-interrupted receive */
+        while (n == -1 && errno == EINTR)
+                n = recvmsg(sock, &msg, 0);
+
+        if (n <= 0)
+                _exit(0);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+        if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+                _exit(1);
+
+        int fds[3];
+
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+        /* wire up the job's standard file descriptors */
+        for (int i = 0; i < 3; i++)
+                if (dup2(fds[i], i) == -1)
+                        _exit(1);
+
+        for (int i = 0; i < 3; i++)
+                if (fds[i] > STDERR_FILENO)
+                        (void)close(fds[i]);
+
+        (void)close(sock);
+
+        /* unpack the resolved path and the NUL-separated argv */
+        uint32_t argc;
+
+        memcpy(&argc, buf, sizeof(argc));
+
+        char* p = buf + sizeof(argc);
+        char* path = p;
+        char* argv[argc + 1];
+
+        p += strlen(p) + 1;
+
+        for (uint32_t i = 0; i < argc; i++) {
+                argv[i] = p;
+                p += strlen(p) + 1;
+        }
+
+        argv[argc] = NULL;
+
+        (void)execv(path, argv);
+
+        (void)error("command not found");
+        _exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief fork one dormant helper into an empty pool slot
+ *
+ * @param slot the pool slot to fill
+ * @return 0 if successful; -1 otherwise
+ */
+int prefork_spawn_helper(size_t slot)
+{
+        int socks[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks))
+                return -1;
+
+        pid_t pid = fork();
+
+        if (pid == -1) {
+                (void)close(socks[0]);
+                (void)close(socks[1]);
+                return -1;
+        }
+
+        if (!pid) {  /* helper child */
+                (void)close(socks[0]);
+
+                /* drop the other helpers' control sockets so each helper */
+                /* sees end-of-stream as soon as the shell itself exits */
+                for (size_t i = 0; i < prefork_size; i++)
+                        if (prefork_pool[i].sock != -1)
+                                (void)close(prefork_pool[i].sock);
+
+                prefork_helper_main(socks[1]);
+                _exit(0);
+        }
+
+        (void)close(socks[1]);
+        prefork_pool[slot].pid = pid;
+        prefork_pool[slot].sock = socks[0];
+
+        return 0;
+}
+
+/**
+ * @brief fork the configured number of dormant helpers
+ *
+ * called once at startup, before the history file is mapped and the
+ * caches warm up, so the helpers stay small no matter how large the
+ * shell's own footprint grows.
+ */
+void prefork_init(void)
+{
+        const char* size_str = getenv("SSHELL_PREFORK");
+        long want = size_str ? atol(size_str) : 0;
+
+        if (want < 0)
+                want = 0;
+
+        if (want > PREFORK_MAX)
+                want = PREFORK_MAX;
+
+        prefork_size = want;
+
+        for (size_t slot = 0; slot < prefork_size; slot++)
+                prefork_pool[slot].sock = -1;
+
+        for (size_t slot = 0; slot < prefork_size; slot++)
+                (void)prefork_spawn_helper(slot);
+}
+
+/**
+ * @brief refork replacements for consumed helpers
+ *
+ * called between commandlines so the replacement fork happens off the
+ * launch-latency-critical path.
+ */
+void prefork_refill(void)
+{
+        for (size_t slot = 0; slot < prefork_size; slot++)
+                if (prefork_pool[slot].sock == -1)
+                        (void)prefork_spawn_helper(slot);
+}
+
+/**
+ * @brief launch a process through a dormant preforked helper
+ *
+ * launching is one `sendmsg` carrying the argv and the process's fd set
+ * (via SCM_RIGHTS) instead of a fork of the potentially large parent,
+ * so launch cost stays constant regardless of shell RSS. the consumed
+ * helper becomes the job (its pid is returned), and its slot is
+ * refilled between commandlines.
+ *
+ * @param proc the process to launch
+ * @return the helper's pid; -1 when no helper or the command cannot be
+ * resolved (the caller falls back to the other launch paths)
+ */
+pid_t prefork_launch(struct process* proc)
+{
+        if (!prefork_size)
+                return -1;
+
+        struct prefork_helper* helper = NULL;
+
+        for (size_t slot = 0; slot < prefork_size; slot++) {
+                if (prefork_pool[slot].sock != -1) {
+                        helper = &prefork_pool[slot];
+                        break;
+                }
+        }
+
+        if (!helper)
+                return -1;
+
+        /* the helper has no PATH cache, so resolve here; an unresolvable */
+        /* command falls back to fork + exec to report the error */
+        const char* path = resolve_command(proc->argv[0]);
+
+        if (!path)
+                return -1;
+
+        /* serialize the resolved path and argv, NUL separated */
+        char buf[PREFORK_MSG_MAX];
+        uint32_t argc = 0;
+        size_t len = sizeof(argc);
+        size_t path_len = strlen(path) + 1;
+
+        if (len + path_len > sizeof(buf))
+                return -1;
+
+        memcpy(buf + len, path, path_len);
+        len += path_len;
+
+        for (; proc->argv[argc]; argc++) {
+                size_t arg_len = strlen(proc->argv[argc]) + 1;
+
+                /* an oversized argv takes the regular launch paths */
+                if (len + arg_len > sizeof(buf))
+                        return -1;
+
+                memcpy(buf + len, proc->argv[argc], arg_len);
+                len += arg_len;
+        }
+
+        memcpy(buf, &argc, sizeof(argc));
+
+        int fds[3] = { proc->fd_in, proc->fd_out, proc->fd_err };
+        union {
+                struct cmsghdr align;
+                char data[CMSG_SPACE(sizeof(fds))];
+        } cmsg_buf;
+
+        struct iovec iov = { buf, len };
+        struct msghdr msg = { 0 };
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsg_buf.data;
+        msg.msg_controllen = sizeof(cmsg_buf.data);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        ssize_t sent = sendmsg(helper->sock, &msg, MSG_NOSIGNAL);
+
+        while (sent == -1 && errno == EINTR)
+                sent = sendmsg(helper->sock, &msg, MSG_NOSIGNAL);
+
+        pid_t pid = helper->pid;
+
+        /* the helper is consumed either way: it execs the job on */
+        /* success and is respawned by the next refill on failure */
+        (void)close(helper->sock);
+        helper->sock = -1;
+
+        if (sent == -1) {
+                (void)waitpid(pid, NULL, 0);
+                return -1;
+        }
+
+        return pid;
+}
+
+/* SECTION 11: Process Execution */
+
+/**
+ * @brief close non-standard input, output, and error file descriptors of a process
+ */
+void close_nonstd_fds(const struct process* proc)
+{
+        if (proc->fd_in != STDIN_FILENO)
+                (void)close(proc->fd_in);
+
+        if (proc->fd_out != STDOUT_FILENO)
+                (void)close(proc->fd_out);
+
+        if (proc->fd_err != STDERR_FILENO)
+                (void)close(proc->fd_err);
+}
+
+/**
+ * @brief execute a process (never returns)
  *
  * @param proc the process to be executed
  */
-void exec_proc(const struct process* proc)
+void exec_proc(const struct process* proc)
+{
+        /* duplicate file descriptors according to what's specified in proc */
+        /* dup2 will do nothing if the 2 values supplied are the same */
+
+        if (dup2(proc->fd_in, STDIN_FILENO) == -1)
+                exit_with_sys_err("dup2");
+
+        if (dup2(proc->fd_out, STDOUT_FILENO) == -1)
+                exit_with_sys_err("dup2");
+
+        if (dup2(proc->fd_err, STDERR_FILENO) == -1)
+                exit_with_sys_err("dup2");
+
+        /* close duplicated file descriptors */
+        close_nonstd_fds(proc);
+
+        /* the splice built-ins run in the forked child when they appear */
+        /* inside a pipeline (no external binary to exec) */
+        if (!strcmp(proc->argv[0], "scat"))
+                _exit(scat_run(proc->argv, STDIN_FILENO, STDOUT_FILENO));
+
+        if (!strcmp(proc->argv[0], "stee"))
+                _exit(stee_run(proc->argv, STDIN_FILENO, STDOUT_FILENO));
+
+        /* exec the cached resolved path directly, skipping the PATH walk */
+        const char* resolved = resolve_command(proc->argv[0]);
+
+        if (resolved)
+                (void)execv(resolved, proc->argv);
+
+        /* fall back to a full PATH search (covers stale cache entries) */
+        (void)execvp(proc->argv[0], proc->argv);
+
+        (void)error("command not found");
+        exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief record close actions for the non-standard fds of a process
+ *
+ * mirrors `close_nonstd_fds` for the posix_spawn fast path, except a file
+ * descriptor is never closed twice (a failing close action would abort
+ * the spawn, unlike the ignored second close in the fork path).
+ *
+ * @param actions the file actions the close actions are recorded into
+ * @param proc the process whose fds should be closed
+ * @return 0 if successful; an errno value otherwise
+ */
+int add_close_actions(posix_spawn_file_actions_t* actions, const struct process* proc)
+{
+        int err = 0;
+
+        if (proc->fd_in != STDIN_FILENO)
+                err = posix_spawn_file_actions_addclose(actions, proc->fd_in);
+
+        if (!err && proc->fd_out != STDOUT_FILENO)
+                err = posix_spawn_file_actions_addclose(actions, proc->fd_out);
+
+        if (!err && proc->fd_err != STDERR_FILENO && proc->fd_err != proc->fd_out)
+                err = posix_spawn_file_actions_addclose(actions, proc->fd_err);
+
+        return err;
+}
+
+/**
+ * @brief launch a process with posix_spawn (fast path)
+ *
+ * posix_spawn avoids the page-table copy that fork pays, which matters
+ * under memory pressure. the file actions carry the same dup2 + close
+ * sequence that `exec_proc` performs in a forked child, so no in-child
+ * work beyond fd wiring is needed.
+ *
+ * @param procs the full process list (the fds of later processes must be closed too)
+ * @param i the index of the process to launch
+ * @return the pid of the launched process; -1 if the fast path cannot launch it
+ */
+pid_t spawn_proc(struct process* procs[], size_t i)
+{
+        posix_spawn_file_actions_t actions;
+        struct process* proc = procs[i];
+        pid_t pid;
+        int err;
+
+        if (posix_spawn_file_actions_init(&actions))
+                return -1;
+
+        /* wire the process's fds onto standard input, output, and error */
+        err = proc->fd_in != STDIN_FILENO ?
+              posix_spawn_file_actions_adddup2(&actions, proc->fd_in, STDIN_FILENO) : 0;
+
+        if (!err && proc->fd_out != STDOUT_FILENO)
+                err = posix_spawn_file_actions_adddup2(&actions, proc->fd_out, STDOUT_FILENO);
+
+        if (!err && proc->fd_err != STDERR_FILENO)
+                err = posix_spawn_file_actions_adddup2(&actions, proc->fd_err, STDERR_FILENO);
+
+        /* close the duplicated fds and those used by later processes */
+        for (size_t j = i; !err && procs[j]; j++)
+                err = add_close_actions(&actions, procs[j]);
+
+        if (!err) {
+                /* spawn the cached resolved path directly, skipping the PATH walk */
+                const char* resolved = resolve_command(proc->argv[0]);
+
+                err = resolved ?
+                      posix_spawn(&pid, resolved, &actions, NULL, proc->argv, environ) :
+                      posix_spawnp(&pid, proc->argv[0], &actions, NULL, proc->argv, environ);
+        }
+
+        (void)posix_spawn_file_actions_destroy(&actions);
+
+        return err ? -1 : pid;
+}
+
+/**
+ * @brief determines if a process needs no fd wiring before exec
+ */
+bool proc_has_std_fds(const struct process* proc)
+{
+        return proc->fd_in == STDIN_FILENO &&
+               proc->fd_out == STDOUT_FILENO &&
+               proc->fd_err == STDERR_FILENO;
+}
+
+/**
+ * @brief launch a single process with vfork (minimal-cost path)
+ *
+ * the child borrows the parent's address space until it execs, so no
+ * page tables are copied at all; this is only legal because the child
+ * does nothing but exec. reserved for processes with all-standard fds,
+ * where the dup2/close wiring of the other launch paths is a no-op.
+ *
+ * the command is resolved before the vfork so the child never touches
+ * the PATH cache; if the resolved path goes stale before the exec, the
+ * child exits with status 127 (it cannot safely report an error).
+ *
+ * @param proc the process to launch
+ * @return the pid of the launched process; -1 if it cannot be launched this way
+ */
+pid_t vfork_proc(struct process* proc)
+{
+        const char* resolved = resolve_command(proc->argv[0]);
+
+        if (!resolved)
+                return -1;
+
+        pid_t pid = vfork();
+
+        if (pid == -1)
+                return -1;
+
+        if (!pid) {  /* child: exec immediately, nothing else is legal */
+                (void)execv(resolved, proc->argv);
+                _exit(127);
+        }
+
+        return pid;
+}
+
+/**
+ * @brief launch every process of a commandline without waiting for them
+ *
+ * @param procs a list of processes to launch
+ * @param pids output list of the pids of the launched processes
+ * @return the number of processes launched
+ */
+size_t launch_procs(struct process* procs[], pid_t pids[])
+{
+        size_t i = 0;
+
+        while (procs[i]) {
+                pid_t pid = -1;
+
+                /* pool path: hand the process to a dormant preforked */
+                /* helper (one sendmsg instead of a fork of the parent) */
+                pid = prefork_launch(procs[i]);
+
+                if (pid != -1)
+                        stats.prefork_launches++;
+
+                /* minimal path: vfork + exec for a lone process that */
+                /* needs no fd wiring (no pipes and no redirection) */
+                if (pid == -1 && !i && !procs[1] && proc_has_std_fds(procs[0])) {
+                        pid = vfork_proc(procs[0]);
+
+                        if (pid != -1)
+                                stats.vforks++;
+                }
+
+                /* fast path: launch with posix_spawn */
+                if (pid == -1) {
+                        pid = spawn_proc(procs, i);
+
+                        if (pid != -1)
+                                stats.spawns++;
+                }
+
+                /* fall back to fork + exec when the fast path cannot launch */
+                /* (e.g. command not found, so the child reports the error) */
+                if (pid == -1) {
+                        pid = fork();
+
+                        if (pid == -1)
+                                exit_with_sys_err("fork");
+
+                        stats.forks++;
+
+                        if (!pid) {  /* child */
+                                /**
+                                 * close file descriptors used by other processes after index i.
+                                 * since file descriptors for processes before index i are already closed
+                                 * in previous iterations of this loop by the parent before this fork,
+                                 * now file descriptors used by ALL other processes are closed.
+                                 */
+                                for (size_t j = i + 1; procs[j]; j++)
+                                        close_nonstd_fds(procs[j]);
+
+                                exec_proc(procs[i]);
+                        }
+                }
+
+                /* parent */
+                /**
+                 * close file descriptors used by the launched child.
+                 * the children to be launched in the next iteration do not need to
+                 * close the file descriptors of the processes launched before it.
+                 */
+                close_nonstd_fds(procs[i]);
+
+                /* save the child's pid */
+                pids[i++] = pid;
+                stats.procs_launched++;
+        }
+
+        return i;
+}
+
+/* whether per-command resource usage is reported (the `timing` built-in) */
+static bool timing_enabled;
+
+/* per-child resource usage captured when timing mode is on */
+struct proc_usage {
+        struct rusage rusage;
+        uint64_t exit_ns;
+};
+
+/**
+ * @brief collect the exit statuses of a set of children as they exit
+ *
+ * each child is watched through a pidfd so one `poll` loop multiplexes
+ * completion across the whole set: statuses are collected in exit order
+ * rather than blocking on the slowest pid first, so no zombie lingers
+ * while an earlier pipeline stage is still running. falls back to
+ * sequential blocking waits on kernels without `pidfd_open`.
+ *
+ * @param pids the pids of the children to reap
+ * @param statuses output list of exit statuses (parallel to `pids`)
+ * @param n the number of children
+ * @param usages optional output list of per-child resource usage
+ * (captured via `wait4`) and exit timestamps; NULL when not needed
+ */
+void reap_procs(const pid_t pids[], int statuses[], size_t n,
+                struct proc_usage* usages)
+{
+        struct pollfd* pfds = arena_alloc(n * sizeof(struct pollfd));
+        size_t live = n;
+
+        for (size_t i = 0; i < n; i++) {
+                pfds[i].fd = syscall(SYS_pidfd_open, pids[i], 0);
+                pfds[i].events = POLLIN;
+
+                /* no pidfd support: reap the rest by blocking in order */
+                if (pfds[i].fd == -1) {
+                        for (size_t j = 0; j < n; j++) {
+                                if (j < i)
+                                        (void)close(pfds[j].fd);
+
+                                int status;
+                                (void)wait4(pids[j], &status, 0,
+                                            usages ? &usages[j].rusage : NULL);
+                                statuses[j] = WEXITSTATUS(status);
+
+                                if (usages)
+                                        usages[j].exit_ns = now_ns();
+                        }
+
+                        return;
+                }
+        }
+
+        while (live) {
+                if (poll(pfds, n, -1) == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        exit_with_sys_err("poll");
+                }
+
+                for (size_t i = 0; i < n; i++) {
+                        if (!(pfds[i].revents & POLLIN))
+                                continue;
+
+                        int status;
+                        (void)wait4(pids[i], &status, 0,
+                                    usages ? &usages[i].rusage : NULL);
+                        statuses[i] = WEXITSTATUS(status);
+
+                        if (usages)
+                                usages[i].exit_ns = now_ns();
+
+                        (void)close(pfds[i].fd);
+                        pfds[i].fd = -1;  /* poll ignores negative fds */
+                        live--;
+                }
+        }
+}
+
+/**
+ * @brief run a list of processes and returns when all of them are exited
+ *
+ * @param procs a list of processes to run
+ * @param statuses the -1 ternimated output list of the exit statuses of processes
+ */
+void run_procs(struct process* procs[], int statuses[])
+{
+        size_t n = 0;
+
+        while (procs[n])
+                n++;
+
+        pid_t* pids = arena_alloc(n * sizeof(pid_t));
+        struct proc_usage* usages = timing_enabled ?
+                                    arena_alloc(n * sizeof(struct proc_usage)) :
+                                    NULL;
+
+        uint64_t launch_ns = now_ns();
+        size_t i = launch_procs(procs, pids);
+
+        /* terminate array using -1 */
+        statuses[i] = -1;
+
+        /* wait for all children to exit */
+        uint64_t wait_start = now_ns();
+
+        reap_procs(pids, statuses, i, usages);
+
+        stats.waitpid_ns += now_ns() - wait_start;
+
+        /* report per-child resource usage and launch-to-exit latency */
+        for (size_t j = 0; usages && j < i; j++) {
+                const struct rusage* ru = &usages[j].rusage;
+
+                fprintf(stderr,
+                        "+ timing '%s' user %.3fs sys %.3fs maxrss %ldKB "
+                        "majflt %ld nvcsw %ld wall %.3fs\n",
+                        procs[j]->argv[0],
+                        ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6,
+                        ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6,
+                        ru->ru_maxrss, ru->ru_majflt, ru->ru_nvcsw,
+                        (usages[j].exit_ns - launch_ns) / 1e9);
+        }
+}
+
+/* SECTION 12: Background Jobs */
+
+/* a background job: one commandline's processes running asynchronously */
+/* (pids, statuses, and the commandline are malloc-ed, not arena-allocated, */
+/*  because a job outlives the per-commandline arena reset) */
+struct job {
+        bool used;
+        char* cmdline;
+        pid_t* pids;
+        int* statuses;
+        size_t num_procs;
+        size_t num_live;
+};
+
+/* table of background jobs in flight */
+static struct job jobs[JOB_MAX];
+
+/* number of background jobs in flight */
+static size_t num_jobs;
+
+/* set by the SIGCHLD handler when at least one child may have exited */
+static volatile sig_atomic_t sigchld_pending;
+
+/**
+ * @brief SIGCHLD handler: note that some child has exited
+ *
+ * reaping happens in the main loop via `reap_jobs`; the handler only
+ * raises a flag so no async-signal-unsafe work is done here.
+ */
+void handle_sigchld(int sig)
+{
+        (void)sig;
+        sigchld_pending = 1;
+}
+
+/**
+ * @brief launch a list of processes as a background job
+ *
+ * returns immediately after launching; the processes are recorded in the
+ * job table and reaped by `reap_jobs` as they exit.
+ *
+ * @param procs a list of processes to run
+ * @param cmdline the commandline, kept for the completion message
+ * @return 0 if successful; -1 if the job table is full
+ */
+int run_procs_async(struct process* procs[], const char* cmdline)
+{
+        struct job* job = NULL;
+
+        /* find a free job table slot */
+        for (size_t j = 0; j < JOB_MAX; j++) {
+                if (!jobs[j].used) {
+                        job = &jobs[j];
+                        break;
+                }
+        }
+
+        if (!job)
+                return error("too many active jobs");
+
+        size_t n = 0;
+
+        while (procs[n])
+                n++;
+
+        job->pids = malloc(n * sizeof(pid_t));
+        job->statuses = malloc(n * sizeof(int));
+        job->cmdline = strdup(cmdline);
+
+        /* check malloc failure */
+        if (!job->pids || !job->statuses || !job->cmdline)
+                exit(EXIT_FAILURE);
+
+        job->num_procs = launch_procs(procs, job->pids);
+        job->num_live = job->num_procs;
+        job->used = true;
+        num_jobs++;
+        stats.jobs_started++;
+
+        return 0;
+}
+
+/**
+ * @brief reap exited background processes without blocking
+ *
+ * emits the `+ completed` line of a job once every one of its processes
+ * has exited, then frees its job table slot.
+ */
+void reap_jobs(void)
+{
+        sigchld_pending = 0;
+
+        for (size_t j = 0; j < JOB_MAX; j++) {
+                struct job* job = &jobs[j];
+
+                if (!job->used)
+                        continue;
+
+                /* collect the statuses of exited processes */
+                for (size_t i = 0; i < job->num_procs; i++) {
+                        int status;
+
+                        if (job->pids[i] == -1)
+                                continue;
+
+                        if (waitpid(job->pids[i], &status, WNOHANG) > 0) {
+                                job->statuses[i] = WEXITSTATUS(status);
+                                job->pids[i] = -1;
+                                job->num_live--;
+                        }
+                }
+
+                if (job->num_live)
+                        continue;
+
+                /* the whole job is done: report it and free the slot */
+                fprintf(stderr, "+ completed '%s' ", job->cmdline);
+                for (size_t i = 0; i < job->num_procs; i++)
+                        fprintf(stderr, "[%d]", job->statuses[i]);
+                fprintf(stderr, "\n");
+
+                free(job->pids);
+                free(job->statuses);
+                free(job->cmdline);
+                job->used = false;
+                num_jobs--;
+        }
+}
+
+/* SECTION 13: Benchmark Harness */
+
+/* representative commandlines exercised by the parse benchmark */
+static const char* bench_corpus[] = {
+        "echo hello world",
+        "ls -l -a /usr/bin > /dev/null",
+        "cat notes.txt | grep -v done | sort | wc -l",
+        "gcc -O2 -Wall -o prog main.c util.c io.c |& tee build.log",
+        "du -s /var/tmp > /dev/null",
+};
+
+#define BENCH_CORPUS_LEN (sizeof(bench_corpus) / sizeof(bench_corpus[0]))
+
+/**
+ * @brief compare two timing samples (qsort callback)
+ */
+int cmp_sample(const void* a, const void* b)
+{
+        uint64_t x = *(const uint64_t*)a;
+        uint64_t y = *(const uint64_t*)b;
+
+        return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief report one benchmark's timing distribution
+ *
+ * @param name benchmark name
+ * @param samples per-op latencies in nanoseconds (sorted in place)
+ * @param n number of samples
+ * @param allocs_per_op average arena allocations per op (0 to omit)
+ */
+void bench_report(const char* name, uint64_t* samples, size_t n, double allocs_per_op)
+{
+        uint64_t total = 0;
+
+        qsort(samples, n, sizeof(uint64_t), cmp_sample);
+
+        for (size_t i = 0; i < n; i++)
+                total += samples[i];
+
+        printf("%s: %zu ops, %llu ns/op (p50 %llu, p99 %llu)",
+               name, n,
+               (unsigned long long)(total / n),
+               (unsigned long long)samples[(n - 1) * 50 / 100],
+               (unsigned long long)samples[(n - 1) * 99 / 100]);
+
+        if (allocs_per_op)
+                printf(", %.1f allocs/op", allocs_per_op);
+
+        printf("\n");
+}
+
+/**
+ * @brief `bench` built-in: microbenchmark the parse and spawn hot paths
+ *
+ * measures tokenization + parsing over a corpus of representative
+ * commandlines, the launch-to-reap latency of `/bin/true` through
+ * run_procs, and the cold-start latency of a fresh shell (exec of
+ * /proc/self/exe until exit), so parse cost, spawn cost and startup
+ * cost can be tracked independently across changes.
+ */
+int builtin_bench(int argc, char* argv[], struct process* proc)
+{
+        static uint64_t samples[BENCH_PARSE_ITERS];
+
+        (void)argc;
+        (void)argv;
+        (void)proc;
+
+        struct arena_mark mark = arena_save();
+        size_t allocs_before = arena_alloc_count;
+
+        /* parse benchmark: tokenize + parse, then rewind the arena and */
+        /* close the pipes/redirections the parse opened */
+        for (size_t i = 0; i < BENCH_PARSE_ITERS; i++) {
+                const char* line = bench_corpus[i % BENCH_CORPUS_LEN];
+                struct process** procs;
+                bool background = false;
+
+                uint64_t t0 = now_ns();
+
+                if (parse_command(line, &procs, &background))
+                        procs = NULL;
+
+                samples[i] = now_ns() - t0;
+
+                for (size_t j = 0; procs && procs[j]; j++)
+                        close_nonstd_fds(procs[j]);
+
+                arena_restore(mark);
+        }
+
+        double allocs_per_op = (double)(arena_alloc_count - allocs_before) / BENCH_PARSE_ITERS;
+
+        bench_report("parse", samples, BENCH_PARSE_ITERS, allocs_per_op);
+
+        /* spawn benchmark: launch and reap /bin/true */
+        struct process true_proc = { 0 };
+        struct process* true_procs[2] = { &true_proc, NULL };
+        int statuses[2];
+
+        true_proc.argv = true_proc.argv_inline;
+        true_proc.argv_inline[0] = "/bin/true";
+        true_proc.argv_inline[1] = NULL;
+        true_proc.fd_in = STDIN_FILENO;
+        true_proc.fd_out = STDOUT_FILENO;
+        true_proc.fd_err = STDERR_FILENO;
+
+        for (size_t i = 0; i < BENCH_SPAWN_ITERS; i++) {
+                uint64_t t0 = now_ns();
+
+                run_procs(true_procs, statuses);
+
+                samples[i] = now_ns() - t0;
+                arena_restore(mark);
+        }
+
+        bench_report("spawn", samples, BENCH_SPAWN_ITERS, 0);
+
+        /* cold-start benchmark: exec a fresh shell on empty input and */
+        /* time it to exit, covering startup initialization end to end */
+        for (size_t i = 0; i < BENCH_COLD_ITERS; i++) {
+                uint64_t t0 = now_ns();
+                pid_t pid = fork();
+
+                if (pid == -1)
+                        exit_with_sys_err("fork");
+
+                if (!pid) {
+                        int null_fd = open("/dev/null", O_RDWR);
+
+                        if (null_fd == -1)
+                                _exit(EXIT_FAILURE);
+
+                        dup2(null_fd, STDIN_FILENO);
+                        dup2(null_fd, STDOUT_FILENO);
+                        dup2(null_fd, STDERR_FILENO);
+                        execl("/proc/self/exe", "sshell", (char*)NULL);
+                        _exit(EXIT_FAILURE);
+                }
+
+                if (waitpid(pid, NULL, 0) == -1)
+                        exit_with_sys_err("waitpid");
+
+                samples[i] = now_ns() - t0;
+        }
+
+        bench_report("cold", samples, BENCH_COLD_ITERS, 0);
+
+        return 0;
+}
+
+/* SECTION 14: Command History */
+
+/* in-memory history: one malloc-ed copy of every accepted commandline */
+static char** history_lines;
+static size_t num_history;
+static size_t history_cap;
+
+/* the mmap-ed append-only history file (enabled via SSHELL_HISTORY) */
+static int history_fd = -1;
+static char* history_map;
+static size_t history_map_cap;
+static size_t history_len;
+
+/* number of lines recorded since the last lazy msync */
+static size_t history_unsynced;
+
+/**
+ * @brief grow the history file and its mapping to at least `cap` bytes
+ *
+ * the file is extended in `HISTORY_CHUNK` steps so the hot loop never
+ * pays a per-line ftruncate; the padding is trimmed off at exit.
+ */
+void history_map_reserve(size_t cap)
+{
+        if (cap <= history_map_cap)
+                return;
+
+        size_t grown = history_map_cap;
+
+        while (grown < cap)
+                grown += HISTORY_CHUNK;
+
+        if (ftruncate(history_fd, grown))
+                exit_with_sys_err("ftruncate");
+
+        char* map = history_map ?
+                    mremap(history_map, history_map_cap, grown, MREMAP_MAYMOVE) :
+                    mmap(NULL, grown, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         history_fd, 0);
+
+        if (map == MAP_FAILED)
+                exit_with_sys_err("mmap");
+
+        history_map = map;
+        history_map_cap = grown;
+}
+
+/**
+ * @brief append one commandline to the in-memory history list
+ */
+void history_append_line(const char* line, size_t len)
+{
+        if (num_history == history_cap) {
+                /* grow the history list geometrically */
+                history_cap = history_cap ? 2 * history_cap : 64;
+                history_lines = realloc(history_lines,
+                                        history_cap * sizeof(char*));
+
+                /* check realloc failure */
+                if (!history_lines)
+                        exit(EXIT_FAILURE);
+        }
+
+        char* copy = malloc(len + 1);
+
+        /* check malloc failure */
+        if (!copy)
+                exit(EXIT_FAILURE);
+
+        memcpy(copy, line, len);
+        copy[len] = '\0';
+        history_lines[num_history++] = copy;
+}
+
+/**
+ * @brief open the history file and load the lines of earlier sessions
+ *
+ * called lazily on first use so sessions that never touch the history
+ * do not pay for the open and load at startup; without SSHELL_HISTORY
+ * in the environment the history is kept in memory only.
+ */
+void history_ensure(void)
+{
+        /* set once the history has been opened (or deliberately not) */
+        static bool history_ready;
+
+        if (history_ready)
+                return;
+
+        history_ready = true;
+
+        const char* path = getenv("SSHELL_HISTORY");
+
+        if (!path)
+                return;
+
+        history_fd = open(path, O_RDWR | O_CREAT, 0600);
+
+        if (history_fd == -1) {
+                (void)error("cannot open history file");
+                return;
+        }
+
+        struct stat st;
+
+        if (fstat(history_fd, &st))
+                exit_with_sys_err("fstat");
+
+        history_map_reserve(st.st_size ? (size_t)st.st_size : 1);
+
+        /* a crashed session leaves chunk padding: trim trailing NULs */
+        history_len = st.st_size;
+
+        while (history_len && !history_map[history_len - 1])
+                history_len--;
+
+        /* load the lines of earlier sessions so `!n` numbering persists */
+        for (size_t pos = 0; pos < history_len;) {
+                char* nl = memchr(history_map + pos, '\n', history_len - pos);
+                size_t len = nl ? (size_t)(nl - history_map) - pos :
+                             history_len - pos;
+
+                history_append_line(history_map + pos, len);
+                pos += len + 1;
+        }
+}
+
+/**
+ * @brief record an accepted commandline in the history
+ *
+ * the line is appended to the in-memory list and written into the
+ * mmap-ed history file; the mapping is msync-ed lazily (every
+ * `HISTORY_SYNC_INTERVAL` lines, asynchronously) so recording adds no
+ * per-line I/O to the hot loop.
+ *
+ * @param cmdline the commandline to record (without trailing newline)
+ */
+void history_record(const char* cmdline)
+{
+        /* blank lines and `!n` recalls are not recorded (the recalled */
+        /* line itself already is, and recording `!n` could loop) */
+        if (!cmdline[0] || cmdline[0] == '!')
+                return;
+
+        history_ensure();
+
+        size_t len = strlen(cmdline);
+
+        history_append_line(cmdline, len);
+
+        if (history_fd == -1)
+                return;
+
+        history_map_reserve(history_len + len + 1);
+        memcpy(history_map + history_len, cmdline, len);
+        history_map[history_len + len] = '\n';
+        history_len += len + 1;
+
+        if (++history_unsynced >= HISTORY_SYNC_INTERVAL) {
+                (void)msync(history_map, history_len, MS_ASYNC);
+                history_unsynced = 0;
+        }
+}
+
+/**
+ * @brief look up a history line for `!n` re-execution
+ *
+ * @param n the 1-based history line number
+ * @return the stored commandline; NULL if the number is out of range
+ */
+const char* history_lookup(size_t n)
+{
+        history_ensure();
+
+        if (!n || n > num_history)
+                return NULL;
+
+        return history_lines[n - 1];
+}
+
+/**
+ * @brief trim the chunk padding off the history file at shell exit
+ */
+void history_close(void)
+{
+        if (history_fd == -1)
+                return;
+
+        (void)msync(history_map, history_len, MS_ASYNC);
+        (void)munmap(history_map, history_map_cap);
+        (void)ftruncate(history_fd, history_len);
+        (void)close(history_fd);
+        history_fd = -1;
+}
+
+/* SECTION 15: Built-in Command Registry */
+
+/**
+ * a built-in command handler.
+ * every built-in has the same shape so new ones can be registered without
+ * touching the main loop: the argument list of the first process plus the
+ * process itself (for built-ins that honor its fd fields).
+ */
+typedef int (*builtin_fn)(int argc, char* argv[], struct process* proc);
+
+/* an entry mapping a built-in command name to its handler */
+struct builtin {
+        const char* name;
+        builtin_fn fn;
+};
+
+/* open-addressing hash table over registered built-ins */
+static struct builtin builtin_table[BUILTIN_TABLE_SIZE];
+
+/* set by the exit built-in to end the main loop */
+static bool shell_exiting;
+
+/**
+ * @brief register a built-in command handler
+ *
+ * @param name built-in command name (not copied; must stay valid)
+ * @param fn handler to run when the name is the first argument of a commandline
+ */
+void register_builtin(const char* name, builtin_fn fn)
+{
+        size_t slot = hash_str(name) % BUILTIN_TABLE_SIZE;
+
+        while (builtin_table[slot].name)
+                slot = (slot + 1) % BUILTIN_TABLE_SIZE;
+
+        builtin_table[slot].name = name;
+        builtin_table[slot].fn = fn;
+}
+
+/**
+ * @brief look up the handler of a built-in command
+ *
+ * @param name command name
+ * @return the registered handler; NULL if the name is not a built-in
+ */
+builtin_fn find_builtin(const char* name)
+{
+        size_t slot = hash_str(name) % BUILTIN_TABLE_SIZE;
+
+        while (builtin_table[slot].name) {
+                if (!strcmp(builtin_table[slot].name, name))
+                        return builtin_table[slot].fn;
+
+                slot = (slot + 1) % BUILTIN_TABLE_SIZE;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief `exit` built-in: leave the shell unless jobs are still running
+ */
+int builtin_exit(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+        (void)proc;
+
+        if (num_jobs) {
+                (void)error("active jobs still running");
+                return 1;
+        }
+
+        fprintf(stderr, "Bye...\n");
+        shell_exiting = true;
+
+        return 0;
+}
+
+/**
+ * @brief `pwd` built-in
+ */
+int builtin_pwd(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+        (void)proc;
+
+        return pwd() ? 1 : 0;
+}
+
+/**
+ * @brief `cd` built-in
+ */
+int builtin_cd(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)proc;
+
+        return cd(argv[1]) ? 1 : 0;
+}
+
+/**
+ * @brief `sls` built-in: honors the fd_out computed by parse_command
+ */
+int builtin_sls(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+
+        int status = sls(proc->fd_out) ? 1 : 0;
+
+        close_nonstd_fds(proc);
+
+        return status;
+}
+
+/**
+ * @brief `rehash` built-in: flush the PATH resolution cache
+ */
+int builtin_rehash(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+        (void)proc;
+
+        path_cache_flush();
+
+        return 0;
+}
+
+/**
+ * @brief `echo` built-in: print the arguments without spawning a process
+ *
+ * honors the `fd_out` already computed by `parse_command`, so
+ * `echo hi > file` works in process, and supports `-n` like the
+ * external echo it shadows (other flags print literally, as the
+ * external echo does for flags it does not know).
+ */
+int builtin_echo(int argc, char* argv[], struct process* proc)
+{
+        int start = 1;
+        bool newline = true;
+
+        /* `-n` suppresses the trailing newline */
+        if (argc > 1 && !strcmp(argv[1], "-n")) {
+                newline = false;
+                start = 2;
+        }
+
+        for (int i = start; i < argc; i++)
+                dprintf(proc->fd_out, "%s%s", argv[i], i + 1 < argc ? " " : "");
+
+        if (newline)
+                dprintf(proc->fd_out, "\n");
+
+        close_nonstd_fds(proc);
+
+        return 0;
+}
+
+/**
+ * @brief `true` built-in
+ */
+int builtin_true(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+
+        close_nonstd_fds(proc);
+
+        return 0;
+}
+
+/**
+ * @brief `false` built-in
+ */
+int builtin_false(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+
+        close_nonstd_fds(proc);
+
+        return 1;
+}
+
+/**
+ * @brief evaluate a `test` expression of up to three operands
+ *
+ * supports the unary file (-e/-f/-d/-r/-w/-x) and string (-n/-z)
+ * operators, string =/!= comparison, and the integer comparisons.
+ *
+ * @param n number of operands
+ * @param args the operands
+ * @return 0 if the expression is true; 1 if false; 2 if malformed
+ */
+int eval_test(int n, char* args[])
+{
+        struct stat st;
+
+        /* no operands: false */
+        if (n == 0)
+                return 1;
+
+        /* one operand: true when the string is non-empty */
+        if (n == 1)
+                return args[0][0] ? 0 : 1;
+
+        if (n == 2) {
+                const char* op = args[0];
+                const char* val = args[1];
+
+                if (!strcmp(op, "-n"))
+                        return val[0] ? 0 : 1;
+
+                if (!strcmp(op, "-z"))
+                        return val[0] ? 1 : 0;
+
+                if (!strcmp(op, "-e"))
+                        return stat(val, &st) ? 1 : 0;
+
+                if (!strcmp(op, "-f"))
+                        return !stat(val, &st) && S_ISREG(st.st_mode) ? 0 : 1;
+
+                if (!strcmp(op, "-d"))
+                        return !stat(val, &st) && S_ISDIR(st.st_mode) ? 0 : 1;
+
+                if (!strcmp(op, "-r"))
+                        return access(val, R_OK) ? 1 : 0;
+
+                if (!strcmp(op, "-w"))
+                        return access(val, W_OK) ? 1 : 0;
+
+                if (!strcmp(op, "-x"))
+                        return access(val, X_OK) ? 1 : 0;
+        }
+
+        if (n == 3) {
+                const char* op = args[1];
+
+                if (!strcmp(op, "="))
+                        return strcmp(args[0], args[2]) ? 1 : 0;
+
+                if (!strcmp(op, "!="))
+                        return strcmp(args[0], args[2]) ? 0 : 1;
+
+                long a = strtol(args[0], NULL, 10);
+                long b = strtol(args[2], NULL, 10);
+
+                if (!strcmp(op, "-eq"))
+                        return a == b ? 0 : 1;
+
+                if (!strcmp(op, "-ne"))
+                        return a != b ? 0 : 1;
+
+                if (!strcmp(op, "-lt"))
+                        return a < b ? 0 : 1;
+
+                if (!strcmp(op, "-le"))
+                        return a <= b ? 0 : 1;
+
+                if (!strcmp(op, "-gt"))
+                        return a > b ? 0 : 1;
+
+                if (!strcmp(op, "-ge"))
+                        return a >= b ? 0 : 1;
+        }
+
+        (void)error("invalid test expression");
+
+        return 2;
+}
+
+/**
+ * @brief `test` (and `[`) built-in
+ */
+int builtin_test(int argc, char* argv[], struct process* proc)
+{
+        int n = argc - 1;
+
+        /* `[` requires a matching closing bracket */
+        if (!strcmp(argv[0], "[")) {
+                if (n < 1 || strcmp(argv[n], "]")) {
+                        close_nonstd_fds(proc);
+                        (void)error("missing closing bracket");
+                        return 2;
+                }
+
+                n--;
+        }
+
+        int status = eval_test(n, argv + 1);
+
+        close_nonstd_fds(proc);
+
+        return status;
+}
+
+/**
+ * @brief `export` built-in: set environment variables
+ *
+ * each `NAME=value` argument is applied with `setenv` and mirrored into
+ * the environment index so later `$NAME` references see the new value.
+ */
+int builtin_export(int argc, char* argv[], struct process* proc)
+{
+        int status = 0;
+
+        env_index_ensure();
+
+        for (int i = 1; i < argc; i++) {
+                char* eq = strchr(argv[i], '=');
+
+                if (!eq || eq == argv[i]) {
+                        (void)error("invalid export assignment");
+                        status = 1;
+                        continue;
+                }
+
+                *eq = '\0';
+
+                if (setenv(argv[i], eq + 1, 1))
+                        exit_with_sys_err("setenv");
+
+                env_index_insert(argv[i], getenv(argv[i]));
+
+                /* a new PATH changes what command names resolve to */
+                if (!strcmp(argv[i], "PATH"))
+                        path_cache_flush();
+        }
+
+        close_nonstd_fds(proc);
+
+        return status;
+}
+
+/**
+ * @brief `history` built-in: print the numbered history lines
+ */
+int builtin_history(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+
+        history_ensure();
+
+        for (size_t i = 0; i < num_history; i++)
+                dprintf(proc->fd_out, "%zu %s\n", i + 1, history_lines[i]);
+
+        close_nonstd_fds(proc);
+
+        return 0;
+}
+
+/**
+ * @brief `scat` built-in (single-stage form: no fork at all)
+ */
+int builtin_scat(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+
+        int status = scat_run(argv, proc->fd_in, proc->fd_out);
+
+        close_nonstd_fds(proc);
+
+        return status;
+}
+
+/**
+ * @brief `stee` built-in (single-stage form: no fork at all)
+ */
+int builtin_stee(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+
+        int status = stee_run(argv, proc->fd_in, proc->fd_out);
+
+        close_nonstd_fds(proc);
+
+        return status;
+}
+
+/**
+ * @brief `timing` built-in: toggle per-command resource usage reporting
+ */
+int builtin_timing(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+
+        timing_enabled = !timing_enabled;
+        dprintf(proc->fd_out, "timing %s\n", timing_enabled ? "on" : "off");
+        close_nonstd_fds(proc);
+
+        return 0;
+}
+
+/**
+ * @brief `stats` built-in: print the instrumentation counters
+ */
+int builtin_stats(int argc, char* argv[], struct process* proc)
+{
+        (void)argc;
+        (void)argv;
+
+        dump_stats(proc->fd_out);
+        close_nonstd_fds(proc);
+
+        return 0;
+}
+
+/**
+ * @brief register every built-in command (called once at startup)
+ */
+void register_builtins(void)
+{
+        register_builtin("exit", builtin_exit);
+        register_builtin("pwd", builtin_pwd);
+        register_builtin("cd", builtin_cd);
+        register_builtin("sls", builtin_sls);
+        register_builtin("rehash", builtin_rehash);
+        register_builtin("echo", builtin_echo);
+        register_builtin("true", builtin_true);
+        register_builtin("false", builtin_false);
+        register_builtin("test", builtin_test);
+        register_builtin("[", builtin_test);
+        register_builtin("bench", builtin_bench);
+        register_builtin("stats", builtin_stats);
+        register_builtin("history", builtin_history);
+        register_builtin("export", builtin_export);
+        register_builtin("timing", builtin_timing);
+        register_builtin("scat", builtin_scat);
+        register_builtin("stee", builtin_stee);
+}
+
+/* SECTION 16: Result Cache */
+
+/* a memoized commandline result: captured stdout bytes and exit statuses */
+/* (entries are malloc-ed because they outlive the per-commandline arena) */
+struct result_entry {
+        char* cmdline;
+        char* output;
+        size_t output_len;
+        int* statuses;
+        uint64_t expires_ns;
+};
+
+/* open-addressing hash table over memoized commandline results */
+static struct result_entry result_cache[RESULT_CACHE_SIZE];
+
+/**
+ * @brief look up a non-expired memoized result for a commandline
+ *
+ * @param cmdline the raw commandline (without the `cacheable` prefix)
+ * @return the cached entry; NULL if absent or past its TTL
+ */
+struct result_entry* result_cache_lookup(const char* cmdline)
+{
+        size_t slot = hash_str(cmdline) % RESULT_CACHE_SIZE;
+
+        /* probe linearly; an empty slot ends the probe chain */
+        for (size_t i = 0; i < RESULT_CACHE_SIZE; i++) {
+                struct result_entry* ent = &result_cache[(slot + i) % RESULT_CACHE_SIZE];
+
+                if (!ent->cmdline)
+                        return NULL;
+
+                if (!strcmp(ent->cmdline, cmdline))
+                        return ent->expires_ns > now_ns() ? ent : NULL;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief memoize the result of a commandline
+ *
+ * an expired entry for the same commandline is refreshed in place; when
+ * the probe chain is full the result is simply not cached.
+ *
+ * @param cmdline the raw commandline (without the `cacheable` prefix)
+ * @param output the captured stdout bytes (malloc-ed, ownership taken)
+ * @param output_len the number of captured bytes
+ * @param statuses the -1 terminated exit statuses to copy
+ */
+void result_cache_insert(const char* cmdline, char* output, size_t output_len,
+                         const int* statuses)
+{
+        size_t slot = hash_str(cmdline) % RESULT_CACHE_SIZE;
+
+        for (size_t i = 0; i < RESULT_CACHE_SIZE; i++) {
+                struct result_entry* ent = &result_cache[(slot + i) % RESULT_CACHE_SIZE];
+
+                if (ent->cmdline && strcmp(ent->cmdline, cmdline))
+                        continue;
+
+                size_t num_statuses = 0;
+
+                while (statuses[num_statuses] != -1)
+                        num_statuses++;
+
+                /* refresh an existing entry in place */
+                free(ent->cmdline);
+                free(ent->output);
+                free(ent->statuses);
+
+                ent->cmdline = strdup(cmdline);
+                ent->output = output;
+                ent->output_len = output_len;
+                ent->statuses = malloc((num_statuses + 1) * sizeof(int));
+
+                /* check malloc failure */
+                if (!ent->cmdline || !ent->statuses)
+                        exit(EXIT_FAILURE);
+
+                memcpy(ent->statuses, statuses, (num_statuses + 1) * sizeof(int));
+                ent->expires_ns = now_ns() + RESULT_CACHE_TTL_NS;
+
+                return;
+        }
+
+        /* table full: skip caching rather than evict mid-probe chain */
+        free(output);
+}
+
+/**
+ * @brief run a pipeline while capturing its stdout into a malloc-ed buffer
+ *
+ * the last process's stdout is rerouted through a pipe that the shell
+ * drains while the children run, so the capture cannot deadlock on a
+ * full pipe buffer.
+ *
+ * @param procs a list of processes to run
+ * @param statuses the -1 terminated output list of the exit statuses
+ * @param output_out receives the captured bytes (malloc-ed)
+ * @param output_len_out receives the number of captured bytes
+ */
+void run_procs_captured(struct process* procs[], int statuses[],
+                        char** output_out, size_t* output_len_out)
+{
+        size_t n = 0;
+
+        while (procs[n])
+                n++;
+
+        /* reroute the pipeline's stdout through a capture pipe (a line */
+        /* whose output is already redirected to a file captures nothing) */
+        int capture_fd = -1;
+
+        if (procs[n - 1]->fd_out == STDOUT_FILENO) {
+                int capture_fds[2];
+
+                if (pipe(capture_fds))
+                        exit_with_sys_err("pipe");
+
+                procs[n - 1]->fd_out = capture_fds[1];
+                capture_fd = capture_fds[0];
+        }
+
+        pid_t* pids = arena_alloc(n * sizeof(pid_t));
+        size_t i = launch_procs(procs, pids);
+
+        statuses[i] = -1;
+
+        /* drain the capture pipe into a growing buffer until EOF */
+        size_t cap = 4096;
+        size_t len = 0;
+        char* output = malloc(cap);
+
+        /* check malloc failure */
+        if (!output)
+                exit(EXIT_FAILURE);
+
+        while (capture_fd != -1) {
+                if (len == cap) {
+                        cap *= 2;
+                        output = realloc(output, cap);
+
+                        if (!output)
+                                exit(EXIT_FAILURE);
+                }
+
+                ssize_t got = read(capture_fd, output + len, cap - len);
+
+                if (got == -1 && errno == EINTR)
+                        continue;
+
+                if (got <= 0)
+                        break;
+
+                len += got;
+        }
+
+        if (capture_fd != -1)
+                close(capture_fd);
+
+        /* collect the exit statuses */
+        uint64_t wait_start = now_ns();
+
+        reap_procs(pids, statuses, i, NULL);
+
+        stats.waitpid_ns += now_ns() - wait_start;
+
+        *output_out = output;
+        *output_len_out = len;
+}
+
+/**
+ * @brief run a `cacheable`-prefixed commandline through the result cache
+ *
+ * on a cache hit the memoized stdout bytes are replayed and the cached
+ * statuses reported without forking; on a miss the pipeline runs with
+ * its stdout captured and the result is memoized with a TTL.
+ *
+ * @param cmdline the raw commandline (without the `cacheable` prefix)
+ * @param full_cmdline the original commandline (for the completed line)
+ * @return 0 if the commandline was handled; -1 if it cannot be cached
+ */
+int run_cacheable(const char* cmdline, const char* full_cmdline)
 {
-        /* duplicate file descriptors according to what's specified in proc */
-        /* dup2 will do nothing if the 2 values supplied are the same */
+        /* an output redirect is a per-run side effect (the file open and */
+        /* write) that the replay path would skip on every hit, silently */
+        /* diverging from re-execution: refuse to cache such lines */
+        if (find_unquoted(cmdline, ">"))
+                return error("cannot cache a redirected command");
 
-        if (dup2(proc->fd_in, STDIN_FILENO) == -1)
-                exit_with_sys_err("dup2");
+        struct result_entry* ent = result_cache_lookup(cmdline);
 
-        if (dup2(proc->fd_out, STDOUT_FILENO) == -1)
-                exit_with_sys_err("dup2");
+        if (ent) {
+                /* replay the memoized output without forking */
+                size_t off = 0;
 
-        if (dup2(proc->fd_err, STDERR_FILENO) == -1)
-                exit_with_sys_err("dup2");
+                while (off < ent->output_len) {
+                        ssize_t n = write(STDOUT_FILENO, ent->output + off,
+                                          ent->output_len - off);
 
-        /* close duplicated file descriptors */
-        close_nonstd_fds(proc);
+                        if (n <= 0)
+                                break;
 
-        (void)execvp(proc->argv[0], proc->argv);
+                        off += n;
+                }
 
-        (void)error("command not found");
-        exit(EXIT_FAILURE);
+                fprintf(stderr, "+ completed '%s' ", full_cmdline);
+                for (size_t i = 0; ent->statuses[i] != -1; i++)
+                        fprintf(stderr, "[%d]", ent->statuses[i]);
+                fprintf(stderr, "\n");
+
+                return 0;
+        }
+
+        struct process** procs;
+        bool background = false;
+
+        if (parse_command(cmdline, &procs, &background))
+                return 0;
+
+        /* a background commandline has no result to memoize */
+        if (background)
+                return error("cannot cache a background command");
+
+        size_t num_procs = 0;
+
+        while (procs[num_procs])
+                num_procs++;
+
+        int* statuses = arena_alloc((num_procs + 1) * sizeof(int));
+        char* output;
+        size_t output_len;
+
+        run_procs_captured(procs, statuses, &output, &output_len);
+
+        /* replay the captured output, then memoize it */
+        size_t off = 0;
+
+        while (off < output_len) {
+                ssize_t n = write(STDOUT_FILENO, output + off, output_len - off);
+
+                if (n <= 0)
+                        break;
+
+                off += n;
+        }
+
+        result_cache_insert(cmdline, output, output_len, statuses);
+
+        fprintf(stderr, "+ completed '%s' ", full_cmdline);
+        for (size_t i = 0; statuses[i] != -1; i++)
+                fprintf(stderr, "[%d]", statuses[i]);
+        fprintf(stderr, "\n");
+
+        return 0;
 }
 
+/* SECTION 17: Commandline Execution */
+
 /**
- * @brief run a list of processes and returns when all of them are exited
+ * @brief determines if a commandline contains `&&` or `||` connectors
  *
- * @param procs a list of processes to run
- * @param statuses the -1 ternimated output list of the exit statuses of processes
+ * the scan honors the tokenizer's quoting rules, so a connector inside
+ * a quoted argument does not make the line a chain.
  */
-void run_procs(struct process* procs[], int statuses[])
+bool cmdline_has_chain(const char* cmdline)
 {
-        int pids[PROCESS_MAX];
-        size_t i = 0;
+        return find_unquoted(cmdline, "&&") || find_unquoted(cmdline, "||");
+}
 
-        while (procs[i]) {
-                pid_t pid = fork();
+/* one member commandline of a `&&&` parallel group */
+struct par_member {
+        char* cmdline;
+        struct process** procs;
+        pid_t* pids;
+        int* statuses;
+        size_t num_procs;
+        bool parsed;
+};
 
-                if (pid == -1)
-                        exit_with_sys_err("fork");
+/**
+ * @brief run the members of a `&&&` parallel group concurrently
+ *
+ * the commandline is split at each `&&&` into member commandlines, all
+ * members are parsed up front, and a sliding window keeps up to one
+ * member per core in flight (launching new members as the oldest ones
+ * are joined). all statuses are gathered and reported in member order
+ * on one combined `+ completed` line.
+ *
+ * @param cmdline the full commandline containing `&&&` separators
+ */
+void run_parallel_group(const char* cmdline)
+{
+        long workers = sysconf(_SC_NPROCESSORS_ONLN);
 
-                if (pid) {  /* parent */
-                        /**
-                         * close file descriptors used by the forked child.
-                         * the children to be forked in the next iteration do not need to
-                         * close the file descriptors of the processes forked before it.
-                         */
-                        close_nonstd_fds(procs[i]);
-
-                        /* save the child's pid */
-                        pids[i++] = pid;
-                } else {  /* child */
-                        /**
-                         * close file descriptors used by other processes after index i.
-                         * since file descriptors for processes before index i are already closed
-                         * in previous iterations of this loop by the parent before this fork,
-                         * now file descriptors used by ALL other processes are closed.
-                         */
-                        for (size_t j = i + 1; procs[j]; j++)
-                                close_nonstd_fds(procs[j]);
-
-                        exec_proc(procs[i]);
-                        return;
+        if (workers < 1)
+                workers = 1;
+
+        /* count the members to size the member list */
+        size_t num_members = 1;
+
+        for (const char* p = cmdline; (p = find_unquoted(p, "&&&")); p += 3)
+                num_members++;
+
+        struct par_member* members = arena_alloc(num_members * sizeof(struct par_member));
+
+        /* split a mutable copy of the commandline at each `&&&` */
+        char* rest = arena_alloc(strlen(cmdline) + 1);
+        strcpy(rest, cmdline);
+
+        for (size_t m = 0; m < num_members; m++) {
+                char* sep = (char*)find_unquoted(rest, "&&&");
+
+                if (sep)
+                        *sep = '\0';
+
+                members[m].cmdline = rest;
+                rest = sep ? sep + 3 : NULL;
+        }
+
+        /* parse every member up front; a member that fails to parse */
+        /* contributes a single failure status to the combined line */
+        for (size_t m = 0; m < num_members; m++) {
+                struct par_member* mem = &members[m];
+                bool background = false;
+
+                /* members run concurrently, so a short-circuit chain */
+                /* inside one has no sequential semantics to honor */
+                if (cmdline_has_chain(mem->cmdline)) {
+                        (void)error("cannot chain inside a parallel group");
+                        mem->parsed = false;
+                } else {
+                        mem->parsed = !parse_command(mem->cmdline, &mem->procs,
+                                                     &background);
+                }
+
+                if (!mem->parsed) {
+                        mem->num_procs = 1;
+                        mem->statuses = arena_alloc(sizeof(int));
+                        mem->statuses[0] = 1;
+                        continue;
                 }
+
+                mem->num_procs = 0;
+
+                while (mem->procs[mem->num_procs])
+                        mem->num_procs++;
+
+                mem->pids = arena_alloc(mem->num_procs * sizeof(pid_t));
+                mem->statuses = arena_alloc(mem->num_procs * sizeof(int));
         }
 
-        /* terminate array using -1 */
-        statuses[i] = -1;
+        size_t launched = 0;
+        size_t joined = 0;
 
-        /* wait for all children to exit */
-        while (i--) {
-                int status;
-                (void)waitpid(pids[i], &status, 0);
-                statuses[i] = WEXITSTATUS(status);
+        while (joined < num_members) {
+                /* keep up to `workers` members in flight */
+                while (launched < num_members && launched - joined < (size_t)workers) {
+                        struct par_member* mem = &members[launched++];
+
+                        if (mem->parsed)
+                                (void)launch_procs(mem->procs, mem->pids);
+                }
+
+                /* join the oldest member still in flight */
+                struct par_member* mem = &members[joined++];
+
+                if (!mem->parsed)
+                        continue;
+
+                reap_procs(mem->pids, mem->statuses, mem->num_procs, NULL);
         }
+
+        /* print the combined return statuses in member order */
+        fprintf(stderr, "+ completed '%s' ", cmdline);
+        for (size_t m = 0; m < num_members; m++)
+                for (size_t i = 0; i < members[m].num_procs; i++)
+                        fprintf(stderr, "[%d]", members[m].statuses[i]);
+        fprintf(stderr, "\n");
+
+        /* reclaim all per-commandline memory at once */
+        arena_reset();
 }
 
-/* SECTION 5: Main Function */
+/**
+ * @brief run a `&&`/`||` command list with short-circuit evaluation
+ *
+ * the commandline is split at each connector; a member after `&&` only
+ * runs when the previous member succeeded and a member after `||` only
+ * when it failed. skipped members cost no parse and no fork. statuses
+ * of the members that ran are reported on one combined `+ completed`
+ * line in order.
+ *
+ * @param cmdline the full commandline containing `&&`/`||` connectors
+ */
+void run_chain(const char* cmdline)
+{
+        /* split a mutable copy of the commandline at each connector; */
+        /* each member remembers the connector that precedes it */
+        char* rest = arena_alloc(strlen(cmdline) + 1);
+        strcpy(rest, cmdline);
+
+        int last_status = 0;
+        char op = '\0';
+        bool first = true;
+
+        /* gather the statuses of the members that ran */
+        size_t num_statuses = 0;
+        size_t status_cap = PROCESS_MAX;
+        int* statuses = arena_alloc(status_cap * sizeof(int));
+
+        while (rest) {
+                char* member = rest;
+                char next_op = '\0';
+
+                /* split at the first unquoted connector (quoted `&&` and */
+                /* `||` belong to the member's arguments) */
+                const char* amp = find_unquoted(rest, "&&");
+                const char* bar = find_unquoted(rest, "||");
+                char* sep = (char*)(amp && (!bar || amp < bar) ? amp : bar);
+
+                if (sep) {
+                        next_op = sep[0];
+                        sep[0] = '\0';
+                        rest = sep + 2;
+                } else {
+                        rest = NULL;
+                }
+
+                /* short-circuit: skip the member without parsing it */
+                if (!first && ((op == '&' && last_status) ||
+                               (op == '|' && !last_status))) {
+                        op = next_op;
+                        continue;
+                }
+
+                first = false;
+                op = next_op;
+
+                struct process** procs;
+                bool background = false;
+
+                if (parse_command(member, &procs, &background)) {
+                        last_status = 1;
+                        continue;
+                }
+
+                /* a chain member runs synchronously so its status can */
+                /* steer the rest of the chain */
+                if (background) {
+                        (void)error("cannot background a chained command");
+                        last_status = 1;
+                        continue;
+                }
+
+                size_t num_procs = 0;
+
+                while (procs[num_procs])
+                        num_procs++;
+
+                int* member_statuses = arena_alloc((num_procs + 1) * sizeof(int));
+
+                /* dispatch single-stage members to built-ins like a */
+                /* standalone commandline */
+                builtin_fn builtin = !procs[1] ?
+                                     find_builtin(procs[0]->argv[0]) : NULL;
+
+                if (builtin) {
+                        int argc = 0;
+
+                        while (procs[0]->argv[argc])
+                                argc++;
+
+                        member_statuses[0] = builtin(argc, procs[0]->argv, procs[0]);
+                        member_statuses[1] = -1;
+                        stats.builtin_hits++;
+                } else {
+                        run_procs(procs, member_statuses);
+                }
+
+                for (size_t i = 0; member_statuses[i] != -1; i++) {
+                        if (num_statuses == status_cap) {
+                                /* grow the status list geometrically */
+                                int* grown = arena_alloc(2 * status_cap * sizeof(int));
+
+                                memcpy(grown, statuses, num_statuses * sizeof(int));
+                                statuses = grown;
+                                status_cap *= 2;
+                        }
+
+                        statuses[num_statuses++] = member_statuses[i];
+                        last_status = member_statuses[i];
+                }
+        }
+
+        /* print the combined return statuses of the members that ran */
+        fprintf(stderr, "+ completed '%s' ", cmdline);
+        for (size_t i = 0; i < num_statuses; i++)
+                fprintf(stderr, "[%d]", statuses[i]);
+        fprintf(stderr, "\n");
 
-int main(void)
+        /* reclaim all per-commandline memory at once */
+        arena_reset();
+        maybe_dump_stats();
+}
+
+/**
+ * @brief parse and run one commandline and report its completion
+ *
+ * shared by the interactive/batch loop and the daemon mode: parses the
+ * commandline, dispatches it to a built-in, a background job, or the
+ * process executor, prints the `+ completed` line, and resets the arena.
+ *
+ * @param cmdline the commandline to execute (without trailing newline)
+ */
+void execute_cmdline(const char* cmdline)
 {
-        char cmdline[CMDLINE_MAX];
+        /* NULL terminated process list (arena-allocated per commandline) */
+        struct process** procs;
+        bool background = false;
+
+        /* a `&&&` group runs its member commandlines concurrently */
+        if (find_unquoted(cmdline, "&&&")) {
+                run_parallel_group(cmdline);
+                return;
+        }
 
-        /* NULL terminated process list */
-        struct process* procs[PROCESS_MAX];
+        /* `!n` re-executes the n-th history line */
+        if (cmdline[0] == '!') {
+                const char* recalled = history_lookup(strtoul(cmdline + 1, NULL, 10));
+
+                if (!recalled) {
+                        (void)error("no such history entry");
+                        return;
+                }
+
+                /* echo the recalled line the way batch mode echoes input */
+                printf("%s\n", recalled);
+                fflush(stdout);
+                execute_cmdline(recalled);
+                return;
+        }
+
+        /* a `cacheable`-prefixed commandline goes through the result cache */
+        if (!strncmp(cmdline, "cacheable ", 10)) {
+                const char* rest = cmdline + 10;
+
+                while (*rest == ' ' || *rest == '\t')
+                        rest++;
+
+                (void)run_cacheable(rest, cmdline);
+                arena_reset();
+                maybe_dump_stats();
+                return;
+        }
+
+        /* a `&&`/`||` command list short-circuits on exit status */
+        if (cmdline_has_chain(cmdline)) {
+                run_chain(cmdline);
+                return;
+        }
+
+        /* parse command line */
+        if (parse_command(cmdline, &procs, &background)) {
+                arena_reset();
+                return;
+        }
+
+        /* count the pipeline's processes to size the status list */
+        size_t num_procs = 0;
+
+        while (procs[num_procs])
+                num_procs++;
 
         /* -1 terminated exit statuses for processes */
-        int statuses[PROCESS_MAX];
+        int* statuses = arena_alloc((num_procs + 1) * sizeof(int));
 
-        while (true) {
-                char *nl;
-                bool exiting = false;
+        /* determine whether its a built-in command: built-ins run */
+        /* in process, so only a single-stage foreground commandline */
+        /* is dispatched here (pipelines exec the external command) */
+        builtin_fn builtin = !procs[1] && !background ?
+                             find_builtin(procs[0]->argv[0]) : NULL;
+
+        if (builtin) {
+                int argc = 0;
+
+                while (procs[0]->argv[argc])
+                        argc++;
+
+                statuses[0] = builtin(argc, procs[0]->argv, procs[0]);
+                statuses[1] = -1;
+                stats.builtin_hits++;
+        } else if (background) {
+                if (run_procs_async(procs, cmdline)) {
+                        /* the job table is full: report the line as failed */
+                        statuses[0] = 1;
+                        statuses[1] = -1;
+                } else {
+                        /* completion is reported once the job finishes */
+                        arena_reset();
+                        maybe_dump_stats();
+                        return;
+                }
+        } else {
+                run_procs(procs, statuses);
+        }
+
+        /* print return statuses */
+        fprintf(stderr, "+ completed '%s' ", cmdline);
+        for (size_t i = 0; statuses[i] != -1; i++)
+                fprintf(stderr, "[%d]", statuses[i]);
+        fprintf(stderr, "\n");
+
+        /* reclaim all per-commandline memory at once */
+        arena_reset();
+        maybe_dump_stats();
+}
+
+/* SECTION 18: Daemon Mode */
+
+/**
+ * @brief read exactly `size` bytes from a file descriptor
+ *
+ * @return 0 if successful; -1 on end of stream or error
+ */
+int read_full(int fd, void* buf, size_t size)
+{
+        char* p = buf;
+
+        while (size) {
+                ssize_t n = read(fd, p, size);
+
+                if (n <= 0)
+                        return -1;
+
+                p += n;
+                size -= n;
+        }
+
+        return 0;
+}
+
+/**
+ * @brief serve the commandlines submitted over one daemon connection
+ *
+ * each message is a 4-byte host-order length prefix followed by the
+ * commandline. the shell's output (echoes, statuses, and the children's
+ * default stdout/stderr) is routed back to the client for the duration
+ * of the connection.
+ *
+ * @param client_fd the connected client socket
+ */
+void serve_client(int client_fd)
+{
+        int saved_out = dup(STDOUT_FILENO);
+        int saved_err = dup(STDERR_FILENO);
+
+        if (saved_out == -1 || saved_err == -1)
+                exit_with_sys_err("dup");
+
+        (void)dup2(client_fd, STDOUT_FILENO);
+        (void)dup2(client_fd, STDERR_FILENO);
+
+        while (!shell_exiting) {
+                uint32_t len;
+
+                if (read_full(client_fd, &len, sizeof(len)))
+                        break;
+
+                char* cmdline = malloc((size_t)len + 1);
+
+                /* check malloc failure */
+                if (!cmdline)
+                        exit(EXIT_FAILURE);
+
+                if (read_full(client_fd, cmdline, len)) {
+                        free(cmdline);
+                        break;
+                }
+
+                cmdline[len] = '\0';
 
-                /* print prompt */
-                printf("sshell@ucd$ ");
+                /* echo the commandline like batch mode does */
+                printf("%s\n", cmdline);
                 fflush(stdout);
 
-                /* get command line */
-                fgets(cmdline, CMDLINE_MAX, stdin);
+                execute_cmdline(cmdline);
+                free(cmdline);
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+
+        /* restore the shell's own stdout/stderr */
+        (void)dup2(saved_out, STDOUT_FILENO);
+        (void)dup2(saved_err, STDERR_FILENO);
+        (void)close(saved_out);
+        (void)close(saved_err);
+}
+
+/**
+ * @brief run as a resident daemon serving commandlines over a UNIX socket
+ *
+ * one resident shell amortizes startup cost and keeps its PATH cache
+ * warm across submissions. connections are served one at a time through
+ * the same execution driver as the interactive loop; a submitted `exit`
+ * shuts the daemon down.
+ *
+ * @param sock_path filesystem path the listening socket is bound to
+ * @return the daemon's exit status
+ */
+int run_daemon(const char* sock_path)
+{
+        struct sockaddr_un addr = { 0 };
+
+        if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+                (void)error("socket path too long");
+                return EXIT_FAILURE;
+        }
+
+        /* a disconnecting client must not kill the resident shell */
+        (void)signal(SIGPIPE, SIG_IGN);
+
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (listen_fd == -1)
+                exit_with_sys_err("socket");
+
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, sock_path);
+
+        /* replace a stale socket file from a previous run */
+        (void)unlink(sock_path);
+
+        if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)))
+                exit_with_sys_err("bind");
+
+        if (listen(listen_fd, 8))
+                exit_with_sys_err("listen");
+
+        while (!shell_exiting) {
+                int client_fd = accept(listen_fd, NULL, NULL);
+
+                if (client_fd == -1) {
+                        if (errno == EINTR)
+                                continue;
+
+                        exit_with_sys_err("accept");
+                }
+
+                serve_client(client_fd);
+                (void)close(client_fd);
+
+                /* report background jobs that finished meanwhile */
+                if (sigchld_pending)
+                        reap_jobs();
+
+                /* refork consumed helpers between connections */
+                prefork_refill();
+        }
+
+        (void)close(listen_fd);
+        (void)unlink(sock_path);
+
+        return EXIT_SUCCESS;
+}
+
+/* SECTION 19: Main Function */
+
+int main(int argc, char* argv[])
+{
+        /* get notified when background children exit */
+        struct sigaction sa = { 0 };
+        sa.sa_handler = handle_sigchld;
+        sa.sa_flags = SA_RESTART;
+
+        if (sigaction(SIGCHLD, &sa, NULL))
+                exit_with_sys_err("sigaction");
+
+        /* the environment index and the history are initialized lazily on */
+        /* first use; only the helper pool must fork while RSS is small */
+        register_builtins();
+        prefork_init();
+
+        /* daemon mode: serve commandlines submitted over a UNIX socket */
+        if (argc == 3 && !strcmp(argv[1], "-d"))
+                return run_daemon(argv[2]);
+
+        /* script mode: read the commandlines from a file, reusing the */
+        /* batch path (the loop below) with the script as standard input */
+        if (argc == 3 && !strcmp(argv[1], "-c")) {
+                int script_fd = open(argv[2], O_RDONLY);
+
+                if (script_fd == -1) {
+                        (void)error("cannot open script file");
+                        return EXIT_FAILURE;
+                }
+
+                if (dup2(script_fd, STDIN_FILENO) == -1)
+                        exit_with_sys_err("dup2");
+
+                close(script_fd);
+        } else if (argc != 1) {
+                (void)error("usage: sshell [-d socket | -c file]");
+                return EXIT_FAILURE;
+        }
+
+        /* determine the input mode once instead of per line */
+        input_interactive = isatty(STDIN_FILENO);
+
+        while (true) {
+                char* cmdline;
+                char* nl;
+
+                /* report background jobs that finished since the last line */
+                if (sigchld_pending)
+                        reap_jobs();
+
+                /* refork consumed helpers off the launch-critical path */
+                prefork_refill();
+
+                /* print prompt (suppressed in batch mode) */
+                if (input_interactive) {
+                        printf("sshell@ucd$ ");
+                        fflush(stdout);
+                }
+
+                /* get command line; stop at end of input */
+                if (!(cmdline = read_cmdline()))
+                        break;
 
                 /* print command line if stdin is not provided by terminal */
-                if (!isatty(STDIN_FILENO)) {
+                if (!input_interactive) {
                         printf("%s", cmdline);
                         fflush(stdout);
                 }
@@ -491,42 +4874,14 @@ int main(void)
                 if (nl)
                         *nl = '\0';
 
-                /* parse command line */
-                if (parse_command(cmdline, procs))
-                        continue;
-
-                /* determine whether its a built-in command */
-                char* first_arg = procs[0]->argv[0];
-
-                if (!strcmp(first_arg, "exit")) {
-                        fprintf(stderr, "Bye...\n");
-                        statuses[0] = 0;
-                        statuses[1] = -1;
-                        exiting = true;
-                } else if (!strcmp(first_arg, "pwd")) {
-                        statuses[0] = pwd() ? 1 : 0;
-                        statuses[1] = -1;
-                } else if (!strcmp(first_arg, "cd")) {
-                        statuses[0] = cd(procs[0]->argv[1]) ? 1 : 0;
-                        statuses[1] = -1;
-                } else if (!strcmp(first_arg, "sls")) {
-                        statuses[0] = sls() ? 1 : 0;
-                        statuses[1] = -1;
-                } else {
-                        run_procs(procs, statuses);
-                }
-
-                /* print return statuses and free malloc-ed memory */
-                fprintf(stderr, "+ completed '%s' ", cmdline);
-                for (size_t i = 0; statuses[i] != -1; i++) {
-                        fprintf(stderr, "[%d]", statuses[i]);
-                        free(procs[i]);
-                }
-                fprintf(stderr, "\n");
+                history_record(cmdline);
+                execute_cmdline(cmdline);
 
-                if (exiting)
+                if (shell_exiting)
                         break;
         }
 
+        history_close();
+
         return EXIT_SUCCESS;
 }